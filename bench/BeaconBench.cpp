@@ -0,0 +1,76 @@
+#include "BenchUtil.h"
+#include "BeaconView.h"
+#include "DeviceHeader.h"
+#include "PixelPusher.h"
+#include <memory>
+
+//the three things DiscoveryListener does with a beacon: parse it, update a
+//known pusher from it, or build a new pusher when it is new or changed
+enum BeaconStep {
+  BEACON_PARSE,
+  BEACON_UPDATE,
+  BEACON_CREATE
+};
+
+static const char* getStepName(BeaconStep step) {
+  switch(step) {
+    case BEACON_PARSE: return "parse";
+    case BEACON_UPDATE: return "update";
+    default: return "create";
+  }
+}
+
+static void measure(const BenchOptions& options, BeaconStep step, int strips) {
+  std::vector<unsigned char> beacon(getBeaconLength(strips));
+  buildBeacon(&beacon[0], strips, 256, 1);
+  std::shared_ptr<PixelPusher> known(new PixelPusher(new DeviceHeader(&beacon[0], beacon.size())));
+  BeaconView view;
+  long long beacons = 0;
+  long long failed = 0;
+  unsigned long long allocationsBefore = getAllocationCount();
+  BenchTimer timer;
+  long long elapsed = 0;
+  while(elapsed < options.minMicros * 1000LL) {
+    //batches keep the clock out of the measurement
+    for(int i = 0; i < 256; i++) {
+      //a new delta sequence each time, like a live controller
+      beacon[BeaconView::sHeaderLength + 12] = beacons + i;
+      if(step == BEACON_CREATE) {
+        std::shared_ptr<PixelPusher> pusher(new PixelPusher(new DeviceHeader(&beacon[0], beacon.size())));
+        continue;
+      }
+      if(!BeaconView::parse(&beacon[0], beacon.size(), view)) {
+        failed++;
+        continue;
+      }
+      if(step == BEACON_UPDATE) {
+        known->updateCounters(view);
+      }
+    }
+    beacons += 256;
+    elapsed = timer.getElapsedNanos();
+  }
+  unsigned long long allocations = getAllocationCount() - allocationsBefore;
+  BenchReport("beacon")
+    .add("step", getStepName(step))
+    .add("strips", (long long)strips)
+    .add("beacons", beacons)
+    .add("failed", failed)
+    .add("ns_per_beacon", (double)elapsed / beacons)
+    .add("allocs_per_beacon", (double)allocations / beacons)
+    .add("beacons_per_s", beacons * 1e9 / elapsed)
+    .print();
+}
+
+void runBeaconBench(const BenchOptions& options) {
+  int stripCounts[] = { 1, 8, 64 };
+  BeaconStep steps[] = { BEACON_PARSE, BEACON_UPDATE, BEACON_CREATE };
+  for(BeaconStep step : steps) {
+    for(int strips : stripCounts) {
+      if(options.quick && strips == 8) {
+        continue;
+      }
+      measure(options, step, strips);
+    }
+  }
+}
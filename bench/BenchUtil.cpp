@@ -0,0 +1,162 @@
+#include "BenchUtil.h"
+#include "BeaconView.h"
+#include "DeviceHeader.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+BenchOptions::BenchOptions() {
+  quick = false;
+  minMicros = 200000;
+}
+
+BenchTimer::BenchTimer() {
+  restart();
+}
+
+void BenchTimer::restart() {
+  mStart = std::chrono::steady_clock::now();
+}
+
+long long BenchTimer::getElapsedNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStart).count();
+}
+
+BenchReport::BenchReport(const char* bench) {
+  mLine = "{\"bench\":\"";
+  mLine += bench;
+  mLine += "\"";
+}
+
+BenchReport& BenchReport::add(const char* key, const char* value) {
+  mLine += ",\"";
+  mLine += key;
+  mLine += "\":\"";
+  mLine += value;
+  mLine += "\"";
+  return *this;
+}
+
+BenchReport& BenchReport::add(const char* key, long long value) {
+  char number[32];
+  snprintf(number, sizeof(number), "%lld", value);
+  mLine += ",\"";
+  mLine += key;
+  mLine += "\":";
+  mLine += number;
+  return *this;
+}
+
+BenchReport& BenchReport::add(const char* key, double value) {
+  char number[32];
+  snprintf(number, sizeof(number), "%.4g", value);
+  mLine += ",\"";
+  mLine += key;
+  mLine += "\":";
+  mLine += number;
+  return *this;
+}
+
+void BenchReport::print() {
+  printf("%s}\n", mLine.c_str());
+  fflush(stdout);
+}
+
+NullTransport::NullTransport() {
+  mPacketsSent = 0;
+  mBytesSent = 0;
+}
+
+bool NullTransport::connect(const std::string&, int, const TransportOptions&) {
+  return true;
+}
+
+bool NullTransport::bind(int, const TransportOptions&) {
+  return true;
+}
+
+void NullTransport::close() {
+}
+
+int NullTransport::send(const iovec* iov, const size_t* starts, size_t packets) {
+  //walk the segments the way a socket would be handed them, but send nothing
+  for(size_t i = starts[0]; i < starts[packets]; i++) {
+    mBytesSent += iov[i].iov_len;
+  }
+  mPacketsSent += packets;
+  return packets;
+}
+
+int NullTransport::receive(unsigned char*, int) {
+  return 0;
+}
+
+int NullTransport::getDescriptor() {
+  return -1;
+}
+
+int NullTransport::getLastError() {
+  return 0;
+}
+
+const char* NullTransport::getName() {
+  return "null";
+}
+
+unsigned long long NullTransport::getPacketsSent() {
+  return mPacketsSent;
+}
+
+unsigned long long NullTransport::getBytesSent() {
+  return mBytesSent;
+}
+
+int getStripsPerPacket(int pixelsPerStrip) {
+  //4 byte sequence number, then a 2 byte strip number and the pixels of each strip
+  return std::max(1, (1460 - 4) / (2 + 3 * pixelsPerStrip));
+}
+
+static void writeShort(unsigned char* data, long value) {
+  data[0] = value & 0xFF;
+  data[1] = (value >> 8) & 0xFF;
+}
+
+static void writeLong(unsigned char* data, long value) {
+  for(int i = 0; i < 4; i++) {
+    data[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+int getBeaconLength(int strips) {
+  return BeaconView::sHeaderLength + 44 + std::max(strips, 8);
+}
+
+int buildBeacon(unsigned char* beacon, int strips, int pixelsPerStrip, long controllerId) {
+  //same layout as PixelPusherEmulator::buildBeacon
+  int flagCount = std::max(strips, 8);
+  int length = getBeaconLength(strips);
+  memset(beacon, 0, length);
+  unsigned char mac[6] = { 0xd8, 0x80, 0x39, (unsigned char)(controllerId >> 16), (unsigned char)(controllerId >> 8), (unsigned char)controllerId };
+  memcpy(&beacon[0], mac, 6);
+  unsigned char ip[4] = { 127, 0, (unsigned char)(controllerId >> 8), (unsigned char)(controllerId + 1) };
+  memcpy(&beacon[6], ip, 4);
+  beacon[10] = PIXELPUSHER;
+  beacon[11] = 1;
+  writeShort(&beacon[12], 2);
+  writeShort(&beacon[14], 1);
+  writeShort(&beacon[16], 1);
+  writeShort(&beacon[18], 140);
+  writeLong(&beacon[20], 100000000);
+
+  unsigned char* remainder = &beacon[BeaconView::sHeaderLength];
+  remainder[0] = strips;
+  remainder[1] = getStripsPerPacket(pixelsPerStrip);
+  writeShort(&remainder[2], pixelsPerStrip);
+  writeLong(&remainder[4], 1000);
+  writeLong(&remainder[16], controllerId);
+  writeLong(&remainder[20], 0);
+  writeShort(&remainder[28], 9897);
+  memset(&remainder[30], 0, flagCount);
+  writeLong(&remainder[32 + flagCount], 0);
+  return length;
+}
@@ -0,0 +1,95 @@
+/*
+ * BenchUtil
+ *
+ * Pieces shared by the headless benchmarks: the allocation counter fed by
+ * the operator new in main.cpp, a transport that counts packets instead of
+ * sending them, a synthetic discovery beacon and one JSON object per line
+ * of output.
+ */
+
+#pragma once
+
+#include "Transport.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct BenchOptions {
+  BenchOptions();
+  // shorter runs and fewer sizes, for a smoke test
+  bool quick;
+  // how long each measurement runs for at least
+  long minMicros;
+};
+
+// heap allocations made by this process so far
+unsigned long long getAllocationCount();
+
+class BenchTimer {
+ public:
+  BenchTimer();
+  void restart();
+  long long getElapsedNanos();
+ private:
+  std::chrono::steady_clock::time_point mStart;
+};
+
+// calls run() until options.minMicros have passed; returns nanoseconds per call
+template <typename Run>
+double timeCalls(const BenchOptions& options, Run run) {
+  for(int i = 0; i < 16; i++) {
+    run();
+  }
+  long long calls = 0;
+  BenchTimer timer;
+  long long elapsed = 0;
+  while(elapsed < options.minMicros * 1000LL) {
+    for(int i = 0; i < 64; i++) {
+      run();
+    }
+    calls += 64;
+    elapsed = timer.getElapsedNanos();
+  }
+  return (double)elapsed / calls;
+}
+
+class BenchReport {
+ public:
+  BenchReport(const char* bench);
+  BenchReport& add(const char* key, const char* value);
+  BenchReport& add(const char* key, long long value);
+  BenchReport& add(const char* key, double value);
+  void print();
+ private:
+  std::string mLine;
+};
+
+class NullTransport : public Transport {
+ public:
+  NullTransport();
+  bool connect(const std::string& address, int port, const TransportOptions& options);
+  bool bind(int port, const TransportOptions& options);
+  void close();
+  int send(const iovec* iov, const size_t* starts, size_t packets);
+  int receive(unsigned char* buffer, int length);
+  int getDescriptor();
+  int getLastError();
+  const char* getName();
+  unsigned long long getPacketsSent();
+  unsigned long long getBytesSent();
+ private:
+  unsigned long long mPacketsSent;
+  unsigned long long mBytesSent;
+};
+
+// strips that fit one 1460 byte datagram, the way the controller firmware advertises it
+int getStripsPerPacket(int pixelsPerStrip);
+// the beacon PixelPusherEmulator sends, without needing a socket; returns its length
+int buildBeacon(unsigned char* beacon, int strips, int pixelsPerStrip, long controllerId);
+int getBeaconLength(int strips);
+
+void runPacketBench(const BenchOptions& options);
+void runBeaconBench(const BenchOptions& options);
+void runSerializeBench(const BenchOptions& options);
+void runFormatBench(const BenchOptions& options);
+void runSenderBench(const BenchOptions& options);
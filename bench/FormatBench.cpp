@@ -0,0 +1,84 @@
+#include "BenchUtil.h"
+#include "PixelFormat.h"
+#include <cstdlib>
+#include <cstring>
+
+//what Strip::serialize() did before each format had its own kernel: one loop
+//for every format that decides per pixel how to lay it out
+static void encodeGeneric(PixelFormat format, const unsigned char* pixels, unsigned char* wire, int count, unsigned int scale) {
+  int channels = getPixelFormatSpec(format).channels;
+  int wireBytes = getPixelFormatSpec(format).wireBytes;
+  for(int i = 0; i < count; i++, pixels += channels, wire += wireBytes) {
+    switch(format) {
+      case PIXEL_GRB:
+        wire[0] = (unsigned char)Serializer::applyScale(pixels[1], scale);
+        wire[1] = (unsigned char)Serializer::applyScale(pixels[0], scale);
+        wire[2] = (unsigned char)Serializer::applyScale(pixels[2], scale);
+        break;
+      case PIXEL_RGBOW:
+        for(int c = 0; c < 3; c++) {
+          wire[c] = (unsigned char)Serializer::applyScale(pixels[c], scale);
+          wire[c + 3] = (unsigned char)Serializer::applyScale(pixels[3], scale);
+          wire[c + 6] = (unsigned char)Serializer::applyScale(pixels[4], scale);
+        }
+        break;
+      case PIXEL_RGB16:
+        for(int c = 0; c < 3; c++) {
+          unsigned int value = Serializer::applyScale((pixels[c] << 8) | pixels[c + 3], scale);
+          wire[c] = (unsigned char)(value >> 8);
+          wire[c + 3] = (unsigned char)value;
+        }
+        break;
+      default:
+        for(int c = 0; c < channels; c++) {
+          wire[c] = (unsigned char)Serializer::applyScale(pixels[c], scale);
+        }
+        break;
+    }
+  }
+}
+
+static void measure(const BenchOptions& options, PixelFormat format, int pixels, double powerScale) {
+  const PixelFormatSpec& spec = getPixelFormatSpec(format);
+  std::vector<unsigned char> input(spec.channels * pixels);
+  std::vector<unsigned char> output(spec.wireBytes * pixels);
+  std::vector<unsigned char> expected(spec.wireBytes * pixels);
+  for(size_t i = 0; i < input.size(); i++) {
+    input[i] = rand() & 0xFF;
+  }
+  unsigned int scale = Serializer::toFixedPoint(powerScale);
+  spec.encode(&input[0], &output[0], pixels, scale);
+  encodeGeneric(format, &input[0], &expected[0], pixels, scale);
+  bool matches = output == expected;
+
+  double specNanos = timeCalls(options, [&]() {
+    spec.encode(&input[0], &output[0], pixels, scale);
+  });
+  double genericNanos = timeCalls(options, [&]() {
+    encodeGeneric(format, &input[0], &output[0], pixels, scale);
+  });
+  BenchReport("format")
+    .add("format", spec.name)
+    .add("power_scale", powerScale)
+    .add("pixels", (long long)pixels)
+    .add("matches", matches ? "yes" : "no")
+    .add("ns_per_pixel", specNanos / pixels)
+    .add("generic_ns_per_pixel", genericNanos / pixels)
+    .add("speedup", genericNanos / specNanos)
+    .print();
+}
+
+void runFormatBench(const BenchOptions& options) {
+  int pixelCounts[] = { 64, 1024, 4096 };
+  double powerScales[] = { 1.0, 0.5 };
+  for(int format = 0; format < PIXEL_FORMATS; format++) {
+    for(int pixels : pixelCounts) {
+      if(options.quick && pixels == 1024) {
+        continue;
+      }
+      for(double powerScale : powerScales) {
+        measure(options, (PixelFormat)format, pixels, powerScale);
+      }
+    }
+  }
+}
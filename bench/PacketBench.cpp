@@ -0,0 +1,89 @@
+#include "BenchUtil.h"
+#include "DeviceHeader.h"
+#include "PixelPusher.h"
+#include "SenderEngine.h"
+#include <memory>
+
+//one frame from the application's pixels to the transport: copy into the
+//strips, publish, then let service() encode and pack it
+static int sendFrame(PixelPusher& pusher, NullTransport& transport, const std::vector<unsigned char>& rgb, int pixels, std::chrono::steady_clock::time_point& now) {
+  int strips = pusher.getNumberOfStrips();
+  for(int s = 0; s < strips; s++) {
+    pusher.getStrip(s)->setRGBPixels(0, &rgb[0], pixels);
+  }
+  pusher.publish();
+  int expected = (strips + getStripsPerPacket(pixels) - 1) / getStripsPerPacket(pixels);
+  unsigned long long target = transport.getPacketsSent() + expected;
+  //a second between calls keeps the pacer full, so only the sending is timed
+  for(int i = 0; i < 4 * expected + 4 && transport.getPacketsSent() < target; i++) {
+    now += std::chrono::seconds(1);
+    pusher.service(now);
+  }
+  return expected;
+}
+
+static void measure(const BenchOptions& options, int strips, int pixels) {
+  std::vector<unsigned char> beacon(getBeaconLength(strips));
+  buildBeacon(&beacon[0], strips, pixels, 1);
+  std::shared_ptr<PixelPusher> pusher(new PixelPusher(new DeviceHeader(&beacon[0], beacon.size())));
+  std::shared_ptr<NullTransport> transport = std::make_shared<NullTransport>();
+  pusher->setTransport(transport, TransportOptions());
+  pusher->setBatchedSend(true);
+  pusher->createCardThread();
+  //drive service() from this thread instead of a worker
+  SenderEngine::getInstance()->removePusher(pusher.get());
+
+  std::vector<unsigned char> rgb(3 * pixels);
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  for(int frame = 0; frame < 8; frame++) {
+    rgb.assign(rgb.size(), frame);
+    sendFrame(*pusher, *transport, rgb, pixels, now);
+  }
+
+  PusherMetricsSnapshot before;
+  pusher->getMetrics(before);
+  unsigned long long packetsBefore = transport->getPacketsSent();
+  unsigned long long allocationsBefore = getAllocationCount();
+  long long frames = 0;
+  BenchTimer timer;
+  long long elapsed = 0;
+  while(elapsed < options.minMicros * 1000LL || frames < 16) {
+    //setRGBPixels marks the whole strip dirty, so every frame is encoded again
+    rgb[0] = frames & 0xFF;
+    rgb[rgb.size() - 1] = frames & 0xFF;
+    sendFrame(*pusher, *transport, rgb, pixels, now);
+    frames++;
+    elapsed = timer.getElapsedNanos();
+  }
+  unsigned long long allocations = getAllocationCount() - allocationsBefore;
+  unsigned long long packets = transport->getPacketsSent() - packetsBefore;
+  PusherMetricsSnapshot after;
+  pusher->getMetrics(after);
+
+  double pixelsSent = (double)frames * strips * pixels;
+  BenchReport("packet")
+    .add("strips", (long long)strips)
+    .add("pixels", (long long)pixels)
+    .add("strips_per_packet", (long long)getStripsPerPacket(pixels))
+    .add("frames", frames)
+    .add("ns_per_pixel", elapsed / pixelsSent)
+    .add("serialize_ns_per_pixel", (after.serializeNanos - before.serializeNanos) / pixelsSent)
+    .add("allocs_per_frame", (double)allocations / frames)
+    .add("packets_per_frame", (double)packets / frames)
+    .add("packets_per_s", packets * 1e9 / elapsed)
+    .print();
+  pusher->destroyCardThread();
+}
+
+void runPacketBench(const BenchOptions& options) {
+  int stripCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+  int pixelCounts[] = { 64, 256, 1024, 4096 };
+  for(int strips : stripCounts) {
+    for(int pixels : pixelCounts) {
+      if(options.quick && ((strips != 1 && strips != 8 && strips != 64) || pixels == 256 || pixels == 1024)) {
+        continue;
+      }
+      measure(options, strips, pixels);
+    }
+  }
+}
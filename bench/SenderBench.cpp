@@ -0,0 +1,94 @@
+#include "BenchUtil.h"
+#include "DeviceHeader.h"
+#include "PixelPusher.h"
+#include "SenderEngine.h"
+#include <memory>
+#include <thread>
+#include <sys/resource.h>
+
+static const int sStrips = 8;
+static const int sPixels = 256;
+static const int sFrameMicros = 16667;
+
+static long long getCpuMicros(int who) {
+  rusage usage;
+  getrusage(who, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+//N paced controllers on a fresh engine, fed 60 frames a second from this thread;
+//the workers' CPU is the process total minus this thread's
+static void measure(const BenchOptions& options, int controllers) {
+  SenderEngine::getInstance()->freeInstance();
+  std::vector<std::shared_ptr<PixelPusher> > pushers;
+  std::vector<std::shared_ptr<NullTransport> > transports;
+  for(int i = 0; i < controllers; i++) {
+    std::vector<unsigned char> beacon(getBeaconLength(sStrips));
+    buildBeacon(&beacon[0], sStrips, sPixels, i + 1);
+    std::shared_ptr<PixelPusher> pusher(new PixelPusher(new DeviceHeader(&beacon[0], beacon.size())));
+    std::shared_ptr<NullTransport> transport = std::make_shared<NullTransport>();
+    pusher->setTransport(transport, TransportOptions());
+    pusher->createCardThread();
+    pushers.push_back(pusher);
+    transports.push_back(transport);
+  }
+
+  std::vector<unsigned char> rgb(3 * sPixels);
+  long long durationMicros = options.quick ? 300000 : 2000000;
+  long long processBefore = getCpuMicros(RUSAGE_SELF);
+  long long appBefore = getCpuMicros(RUSAGE_THREAD);
+  BenchTimer timer;
+  std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+  long long frames = 0;
+  while(timer.getElapsedNanos() < durationMicros * 1000) {
+    rgb.assign(rgb.size(), frames & 0xFF);
+    for(size_t p = 0; p < pushers.size(); p++) {
+      for(int s = 0; s < sStrips; s++) {
+        pushers[p]->getStrip(s)->setRGBPixels(0, &rgb[0], sPixels);
+      }
+      pushers[p]->publish();
+    }
+    frames++;
+    next += std::chrono::microseconds(sFrameMicros);
+    std::this_thread::sleep_until(next);
+  }
+  long long elapsed = timer.getElapsedNanos();
+  long long appMicros = getCpuMicros(RUSAGE_THREAD) - appBefore;
+  long long senderMicros = getCpuMicros(RUSAGE_SELF) - processBefore - appMicros;
+  long lateness = SenderEngine::getInstance()->getMaxLatenessMicros();
+
+  //once a pusher is out of the engine its counters are ours to read
+  unsigned long long packets = 0;
+  unsigned long long framesSent = 0;
+  for(size_t p = 0; p < pushers.size(); p++) {
+    pushers[p]->destroyCardThread();
+    packets += transports[p]->getPacketsSent();
+    PusherMetricsSnapshot metrics;
+    pushers[p]->getMetrics(metrics);
+    framesSent += metrics.framesSent;
+  }
+  BenchReport("sender")
+    .add("controllers", (long long)controllers)
+    .add("workers", (long long)SenderEngine::getInstance()->getWorkerCount())
+    .add("strips", (long long)sStrips)
+    .add("pixels", (long long)sPixels)
+    .add("frames", frames)
+    .add("frames_sent_per_controller", (double)framesSent / controllers)
+    .add("sender_cpu_percent", senderMicros * 100000.0 / elapsed)
+    .add("app_cpu_percent", appMicros * 100000.0 / elapsed)
+    .add("max_lateness_us", (long long)lateness)
+    .add("packets_per_s", packets * 1e9 / elapsed)
+    .print();
+  pushers.clear();
+  SenderEngine::getInstance()->freeInstance();
+}
+
+void runSenderBench(const BenchOptions& options) {
+  int controllerCounts[] = { 1, 4, 16, 64, 150 };
+  for(int controllers : controllerCounts) {
+    if(options.quick && (controllers == 4 || controllers == 64)) {
+      continue;
+    }
+    measure(options, controllers);
+  }
+}
@@ -0,0 +1,104 @@
+#include "BenchUtil.h"
+#include "Serializer.h"
+#include <cstdlib>
+
+//the vectorized kernels against the scalar references they must match
+static void measureScale(const BenchOptions& options, int pixels, double powerScale) {
+  std::vector<unsigned char> input(3 * pixels);
+  std::vector<unsigned char> output(3 * pixels);
+  for(size_t i = 0; i < input.size(); i++) {
+    input[i] = rand() & 0xFF;
+  }
+  unsigned int scale = Serializer::toFixedPoint(powerScale);
+  double kernelNanos = timeCalls(options, [&]() {
+    Serializer::scale(&input[0], &output[0], input.size(), scale);
+  });
+  double referenceNanos = timeCalls(options, [&]() {
+    Serializer::scaleReference(&input[0], &output[0], input.size(), scale);
+  });
+  BenchReport("serialize")
+    .add("kernel", Serializer::getKernelName())
+    .add("op", "scale")
+    .add("power_scale", powerScale)
+    .add("pixels", (long long)pixels)
+    .add("pixels_per_ns", pixels / kernelNanos)
+    .add("reference_pixels_per_ns", pixels / referenceNanos)
+    .add("speedup", referenceNanos / kernelNanos)
+    .print();
+}
+
+//kernels of the wider formats: op, bytes in and out per pixel, kernel and reference
+struct FormatKernel {
+  const char* op;
+  int inputBytes;
+  int outputBytes;
+  Serializer::ScaleKernel kernel;
+  Serializer::ScaleKernel reference;
+};
+
+static void measureFormatKernel(const BenchOptions& options, const FormatKernel& format, int pixels, double powerScale) {
+  std::vector<unsigned char> input(format.inputBytes * pixels);
+  std::vector<unsigned char> output(format.outputBytes * pixels);
+  for(size_t i = 0; i < input.size(); i++) {
+    input[i] = rand() & 0xFF;
+  }
+  unsigned int scale = Serializer::toFixedPoint(powerScale);
+  double kernelNanos = timeCalls(options, [&]() {
+    format.kernel(&input[0], &output[0], pixels, scale);
+  });
+  double referenceNanos = timeCalls(options, [&]() {
+    format.reference(&input[0], &output[0], pixels, scale);
+  });
+  BenchReport("serialize")
+    .add("kernel", Serializer::getKernelName())
+    .add("op", format.op)
+    .add("power_scale", powerScale)
+    .add("pixels", (long long)pixels)
+    .add("pixels_per_ns", pixels / kernelNanos)
+    .add("reference_pixels_per_ns", pixels / referenceNanos)
+    .add("speedup", referenceNanos / kernelNanos)
+    .print();
+}
+
+static void measureRGBOW(const BenchOptions& options, int pixels) {
+  std::vector<unsigned char> rgb(3 * pixels);
+  std::vector<unsigned char> rgbow(5 * pixels);
+  for(size_t i = 0; i < rgb.size(); i++) {
+    rgb[i] = rand() & 0xFF;
+  }
+  double kernelNanos = timeCalls(options, [&]() {
+    Serializer::convertRGBOW(&rgb[0], &rgbow[0], pixels);
+  });
+  double referenceNanos = timeCalls(options, [&]() {
+    Serializer::convertRGBOWReference(&rgb[0], &rgbow[0], pixels);
+  });
+  BenchReport("serialize")
+    .add("kernel", Serializer::getKernelName())
+    .add("op", "convert_rgbow")
+    .add("pixels", (long long)pixels)
+    .add("pixels_per_ns", pixels / kernelNanos)
+    .add("reference_pixels_per_ns", pixels / referenceNanos)
+    .add("speedup", referenceNanos / kernelNanos)
+    .print();
+}
+
+void runSerializeBench(const BenchOptions& options) {
+  int pixelCounts[] = { 64, 128, 256, 512, 1024, 2048, 4096 };
+  for(int pixels : pixelCounts) {
+    if(options.quick && pixels != 64 && pixels != 4096) {
+      continue;
+    }
+    //1.0 is the common case; anything below it does the multiply
+    measureScale(options, pixels, 1.0);
+    measureScale(options, pixels, 0.5);
+    measureRGBOW(options, pixels);
+    FormatKernel formats[] = {
+      { "expand_rgbow", 5, 9, Serializer::expandRGBOW, Serializer::expandRGBOWReference },
+      { "scale_rgb16", 6, 6, Serializer::scaleRGB16, Serializer::scaleRGB16Reference }
+    };
+    for(const FormatKernel& format : formats) {
+      measureFormatKernel(options, format, pixels, 1.0);
+      measureFormatKernel(options, format, pixels, 0.5);
+    }
+  }
+}
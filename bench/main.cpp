@@ -0,0 +1,94 @@
+/*
+ * Headless benchmarks for the sender and discovery paths.  Prints one JSON
+ * object per measurement on stdout.
+ *
+ *   ./pixelpusher-bench [--quick] [suite...]
+ *
+ * With no suite named, all of them run.
+ */
+
+#include "BenchUtil.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+static std::atomic<unsigned long long> sAllocations(0);
+
+void* operator new(size_t size) {
+  sAllocations.fetch_add(1, std::memory_order_relaxed);
+  void* memory = malloc(size ? size : 1);
+  if(memory == NULL) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+  free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+  free(memory);
+}
+
+unsigned long long getAllocationCount() {
+  return sAllocations.load(std::memory_order_relaxed);
+}
+
+struct BenchSuite {
+  const char* name;
+  void (*run)(const BenchOptions& options);
+};
+
+static const BenchSuite sSuites[] = {
+  { "packet", runPacketBench },
+  { "beacon", runBeaconBench },
+  { "serialize", runSerializeBench },
+  { "format", runFormatBench },
+  { "sender", runSenderBench }
+};
+
+static const int sSuiteCount = sizeof(sSuites) / sizeof(sSuites[0]);
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  std::vector<const BenchSuite*> selected;
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--quick") == 0) {
+      options.quick = true;
+      options.minMicros = 20000;
+      continue;
+    }
+    const BenchSuite* suite = NULL;
+    for(int s = 0; s < sSuiteCount; s++) {
+      if(strcmp(argv[i], sSuites[s].name) == 0) {
+        suite = &sSuites[s];
+      }
+    }
+    if(suite == NULL) {
+      fprintf(stderr, "unknown suite %s; have", argv[i]);
+      for(int s = 0; s < sSuiteCount; s++) {
+        fprintf(stderr, " %s", sSuites[s].name);
+      }
+      fprintf(stderr, "\n");
+      return 1;
+    }
+    selected.push_back(suite);
+  }
+  if(selected.empty()) {
+    for(int s = 0; s < sSuiteCount; s++) {
+      selected.push_back(&sSuites[s]);
+    }
+  }
+  for(size_t i = 0; i < selected.size(); i++) {
+    selected[i]->run(options);
+  }
+  return 0;
+}
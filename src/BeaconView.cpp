@@ -0,0 +1,112 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "BeaconView.h"
+#include <cstring>
+
+//the wire is little endian regardless of the host
+static short readShort(const unsigned char* data) {
+  return (short)(data[0] | (data[1] << 8));
+}
+
+static long readLong(const unsigned char* data) {
+  return (long)(int32_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+}
+
+bool BeaconView::parse(const unsigned char* packet, int length, BeaconView& beacon) {
+  if(length < sHeaderLength) {
+    return false;
+  }
+  memcpy(beacon.macAddress, &packet[0], 6);
+  memcpy(beacon.ipAddress, &packet[6], 4);
+  beacon.deviceType = packet[10];
+  beacon.protocolVersion = packet[11];
+  beacon.vendorId = readShort(&packet[12]);
+  beacon.productId = readShort(&packet[14]);
+  beacon.hardwareRevision = readShort(&packet[16]);
+  beacon.softwareRevision = readShort(&packet[18]);
+  beacon.linkSpeed = readLong(&packet[20]);
+  return parseRemainder(&packet[sHeaderLength], length - sHeaderLength, beacon.softwareRevision, beacon);
+}
+
+bool BeaconView::parseRemainder(const unsigned char* remainder, int length, short softwareRevision, BeaconView& beacon) {
+  beacon.remainder = remainder;
+  beacon.remainderLength = length;
+  if(length < 28) {
+    return false;
+  }
+  beacon.stripsAttached = remainder[0];
+  beacon.maxStripsPerPacket = remainder[1];
+  beacon.pixelsPerStrip = readShort(&remainder[2]);
+  beacon.updatePeriod = readLong(&remainder[4]);
+  beacon.powerTotal = readLong(&remainder[8]);
+  beacon.deltaSequence = readLong(&remainder[12]);
+  beacon.controllerId = readLong(&remainder[16]);
+  beacon.groupId = readLong(&remainder[20]);
+  beacon.artnetUniverse = readShort(&remainder[24]);
+  beacon.artnetChannel = readShort(&remainder[26]);
+
+  beacon.port = 9897;
+  if(length >= 30 && softwareRevision > 100) {
+    beacon.port = readShort(&remainder[28]);
+  }
+
+  //flags are sent for at least 8 strips
+  beacon.stripFlagCount = beacon.stripsAttached > 8 ? beacon.stripsAttached : 8;
+  memset(beacon.stripFlags, 0, sizeof(beacon.stripFlags));
+  if(length > 30 && softwareRevision > 108) {
+    int available = length - 30 < beacon.stripFlagCount ? length - 30 : beacon.stripFlagCount;
+    memcpy(beacon.stripFlags, &remainder[30], available);
+  }
+
+  beacon.pusherFlags = 0;
+  beacon.segments = 0;
+  beacon.powerDomain = 0;
+  if(length >= 44 + beacon.stripFlagCount && softwareRevision > 108) {
+    beacon.pusherFlags = readLong(&remainder[32 + beacon.stripFlagCount]);
+    beacon.segments = readLong(&remainder[36 + beacon.stripFlagCount]);
+    beacon.powerDomain = readLong(&remainder[40 + beacon.stripFlagCount]);
+  }
+  return true;
+}
+
+uint64_t BeaconView::getMacKey() const {
+  uint64_t key = 0;
+  for(int i = 0; i < 6; i++) {
+    key = (key << 8) | macAddress[i];
+  }
+  return key;
+}
+
+static uint64_t mix(uint64_t hash, uint64_t value) {
+  //FNV-1a, one byte at a time
+  for(int i = 0; i < 8; i++) {
+    hash ^= (value >> (8 * i)) & 0xFF;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+uint64_t BeaconView::getFingerprint() const {
+  //everything that defines the controller's layout and addressing; the
+  //counters that change from beacon to beacon are left out on purpose
+  uint64_t hash = 14695981039346656037ULL;
+  hash = mix(hash, getMacKey());
+  hash = mix(hash, ((uint64_t)ipAddress[0] << 24) | (ipAddress[1] << 16) | (ipAddress[2] << 8) | ipAddress[3]);
+  hash = mix(hash, (uint64_t)(uint16_t)softwareRevision);
+  hash = mix(hash, (uint64_t)(uint16_t)stripsAttached);
+  hash = mix(hash, (uint64_t)(uint16_t)pixelsPerStrip);
+  hash = mix(hash, (uint64_t)(uint32_t)controllerId);
+  hash = mix(hash, (uint64_t)(uint32_t)groupId);
+  hash = mix(hash, (uint64_t)(uint16_t)artnetUniverse);
+  hash = mix(hash, (uint64_t)(uint16_t)artnetChannel);
+  hash = mix(hash, (uint64_t)(uint16_t)port);
+  for(int i = 0; i < stripFlagCount; i++) {
+    hash = mix(hash, stripFlags[i]);
+  }
+  hash = mix(hash, (uint64_t)(uint32_t)pusherFlags);
+  hash = mix(hash, (uint64_t)(uint32_t)segments);
+  hash = mix(hash, (uint64_t)(uint32_t)powerDomain);
+  return hash;
+}
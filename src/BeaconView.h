@@ -0,0 +1,55 @@
+/*
+ * BeaconView
+ *
+ * A discovery beacon decoded into plain fields on the stack.  Parsing never
+ * allocates, so DiscoveryListener can check a beacon against the registry
+ * and only build DeviceHeader/PixelPusher objects for new or changed
+ * controllers.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+class BeaconView {
+ public:
+  static const int sHeaderLength = 24;
+  static const int sMaxStrips = 256;
+  static bool parse(const unsigned char* packet, int length, BeaconView& beacon);
+  static bool parseRemainder(const unsigned char* remainder, int length, short softwareRevision, BeaconView& beacon);
+  uint64_t getMacKey() const;
+  uint64_t getFingerprint() const;
+
+  // universal discovery header
+  unsigned char macAddress[6];
+  unsigned char ipAddress[4];
+  unsigned char deviceType;
+  unsigned char protocolVersion;
+  short vendorId;
+  short productId;
+  short hardwareRevision;
+  short softwareRevision;
+  long linkSpeed;
+
+  // PixelPusher specific part
+  short stripsAttached;
+  short maxStripsPerPacket;
+  short pixelsPerStrip;
+  long updatePeriod;
+  long powerTotal;
+  long deltaSequence;
+  long controllerId;
+  long groupId;
+  short artnetUniverse;
+  short artnetChannel;
+  short port;
+  int stripFlagCount;
+  unsigned char stripFlags[sMaxStrips];
+  long pusherFlags;
+  long segments;
+  long powerDomain;
+
+  // where the raw bytes came from; only valid while that buffer is
+  const unsigned char* remainder;
+  int remainderLength;
+};
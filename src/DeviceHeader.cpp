@@ -2,12 +2,13 @@
 #include "stdafx.h"
 #endif
 
-#include "ofLog.h"
+#include "PixelPusherLog.h"
 #include "DeviceHeader.h"
+#include <cstring>
 
 DeviceHeader::DeviceHeader(unsigned char* packet, int packetLength) {
   if(packetLength < sHeaderLength) {
-    ofLogWarning() << "Incorrect package length in DeviceHeader constructor!";
+    PP_LOG_WARNING("Incorrect package length in DeviceHeader constructor!");
   }
 
   memcpy(&mMacAddress[0], &packet[0], 6);
@@ -21,15 +22,16 @@ DeviceHeader::DeviceHeader(unsigned char* packet, int packetLength) {
   memcpy(&mLinkSpeed, &packet[20], 4);
 
   if(mSoftwareRevision < mOldestAcceptableSoftwareRevision) {
-    ofLogError() << "This PixelPusher Library requires firmware revision %f", mOldestAcceptableSoftwareRevision / 100.0;
-    ofLogError() << "This PixelPusher is using %f", mSoftwareRevision / 100.0;
-    ofLogError() << "This is not expected to work.  Please update your PixelPusher.";
+    PP_LOG_ERROR("This PixelPusher Library requires firmware revision %.2f", mOldestAcceptableSoftwareRevision / 100.0);
+    PP_LOG_ERROR("This PixelPusher is using %.2f", mSoftwareRevision / 100.0);
+    PP_LOG_ERROR("This is not expected to work.  Please update your PixelPusher.");
   }
         
   mPacketRemainderLength = packetLength - sHeaderLength;
   //replace this with std::vector and std::vector::assign()
-  mPacketRemainder = std::shared_ptr<unsigned char>(new unsigned char[mPacketRemainderLength]);
+  mPacketRemainder = std::shared_ptr<unsigned char>(new unsigned char[mPacketRemainderLength], std::default_delete<unsigned char[]>());
   memcpy(&mPacketRemainder.get()[0], &packet[sHeaderLength], mPacketRemainderLength);
+  formatAddresses();
 
   /*
     strncpy(this->macAddress, (char*)packet, 6);
@@ -47,20 +49,61 @@ DeviceHeader::DeviceHeader(unsigned char* packet, int packetLength) {
   */
 }
 
+DeviceHeader::DeviceHeader(const BeaconView& beacon) {
+  memcpy(&mMacAddress[0], beacon.macAddress, 6);
+  memcpy(&mIpAddress[0], beacon.ipAddress, 4);
+  mDeviceType = static_cast<DeviceType>(beacon.deviceType);
+  mProtocolVersion = beacon.protocolVersion;
+  mVendorId = beacon.vendorId;
+  mProductId = beacon.productId;
+  mHardwareRevision = beacon.hardwareRevision;
+  mSoftwareRevision = beacon.softwareRevision;
+  mLinkSpeed = beacon.linkSpeed;
+
+  if(mSoftwareRevision < mOldestAcceptableSoftwareRevision) {
+    PP_LOG_ERROR("This PixelPusher Library requires firmware revision %.2f", mOldestAcceptableSoftwareRevision / 100.0);
+    PP_LOG_ERROR("This PixelPusher is using %.2f", mSoftwareRevision / 100.0);
+    PP_LOG_ERROR("This is not expected to work.  Please update your PixelPusher.");
+  }
+
+  mPacketRemainderLength = beacon.remainderLength;
+  mPacketRemainder = std::shared_ptr<unsigned char>(new unsigned char[mPacketRemainderLength], std::default_delete<unsigned char[]>());
+  memcpy(&mPacketRemainder.get()[0], beacon.remainder, mPacketRemainderLength);
+  formatAddresses();
+}
+
 DeviceHeader::~DeviceHeader() {
   
 }
 
-std::string DeviceHeader::getMacAddressString() {
+void DeviceHeader::formatAddresses() {
   char strMacAddress[24];
   sprintf(strMacAddress, "%02X:%02X:%02X:%02X:%02X:%02X", mMacAddress[0], mMacAddress[1], mMacAddress[2], mMacAddress[3], mMacAddress[4], mMacAddress[5]);
-  return strMacAddress;
+  mMacAddressString = strMacAddress;
+  char strIpAddress[24];
+  sprintf(strIpAddress, "%u.%u.%u.%u", mIpAddress[0], mIpAddress[1], mIpAddress[2], mIpAddress[3]);
+  mIpAddressString = strIpAddress;
+}
+
+std::string DeviceHeader::getMacAddressString() {
+  return mMacAddressString;
 }
 
 std::string DeviceHeader::getIpAddressString() {
-  char strIpAddress[24];
-  sprintf(strIpAddress, "%u.%u.%u.%u", mIpAddress[0], mIpAddress[1], mIpAddress[2], mIpAddress[3]);
-  return strIpAddress;
+  return mIpAddressString;
+}
+
+bool DeviceHeader::getBeacon(BeaconView& beacon) {
+  memcpy(beacon.macAddress, &mMacAddress[0], 6);
+  memcpy(beacon.ipAddress, &mIpAddress[0], 4);
+  beacon.deviceType = mDeviceType;
+  beacon.protocolVersion = mProtocolVersion;
+  beacon.vendorId = mVendorId;
+  beacon.productId = mProductId;
+  beacon.hardwareRevision = mHardwareRevision;
+  beacon.softwareRevision = mSoftwareRevision;
+  beacon.linkSpeed = mLinkSpeed;
+  return BeaconView::parseRemainder(mPacketRemainder.get(), mPacketRemainderLength, mSoftwareRevision, beacon);
 }
 
 DeviceType DeviceHeader::getDeviceType() {
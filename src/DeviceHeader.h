@@ -4,6 +4,7 @@
 #include <string>
 #include <stdio.h>
 #include <iostream>
+#include "BeaconView.h"
 
 #ifdef TARGET_WIN32
 #include "sdfWindows.hpp"
@@ -20,6 +21,7 @@ enum DeviceType {
 class DeviceHeader {
  public:
   DeviceHeader(unsigned char* packet, int packetLength);
+  DeviceHeader(const BeaconView& beacon);
   ~DeviceHeader();
   std::string getMacAddressString();
   std::string getIpAddressString();
@@ -33,7 +35,9 @@ class DeviceHeader {
   std::shared_ptr<unsigned char> getPacketRemainder();
   int getPacketRemainderLength();
   bool isMulticast();
+  bool getBeacon(BeaconView& beacon);
  private:
+  void formatAddresses();
   static const int sHeaderLength = 24;
   static const int mOldestAcceptableSoftwareRevision = 121;
   unsigned char mMacAddress[6];
@@ -47,4 +51,7 @@ class DeviceHeader {
   long mLinkSpeed;
   std::shared_ptr<unsigned char> mPacketRemainder;
   int mPacketRemainderLength;
+  // formatted once, since they show up in every log line
+  std::string mMacAddressString;
+  std::string mIpAddressString;
 };
@@ -9,8 +9,17 @@
 #endif
 
 #include <memory>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#ifndef TARGET_WIN32
+#include <poll.h>
+#include <unistd.h>
+#endif
 #include "DiscoveryListener.h"
+#include "PixelPusherLog.h"
 #include "DeviceHeader.h"
+#include "SenderEngine.h"
 
 DiscoveryListener* DiscoveryListener::mDiscoveryService = NULL;
 
@@ -30,149 +39,503 @@ int DiscoveryListener::getFrameLimit() {
   return mFrameLimit;
 }
 
-std::vector<std::shared_ptr<PixelPusher> > DiscoveryListener::getPushers() {
-  mUpdateMutex.lock();
-  std::vector<std::shared_ptr<PixelPusher> > pusherVector;
-  for(std::map<std::string, std::shared_ptr<PixelPusher> >::iterator it = mPusherMap.begin();
-	it != mPusherMap.end();
-      ++it) {
-    pusherVector.push_back(it->second);
+static bool memberLess(const RegistrySnapshot::Member& a, const RegistrySnapshot::Member& b) {
+  if(a.groupId != b.groupId) {
+    return a.groupId < b.groupId;
   }
-  mUpdateMutex.unlock();
-  return pusherVector;
+  return a.controllerId < b.controllerId;
 }
 
-std::vector<std::shared_ptr<PixelPusher> > DiscoveryListener::getGroup(long groupId) {
-  mUpdateMutex.lock();
+uint64_t RegistrySnapshot::packIds(long groupId, long controllerId) {
+  //both ids are 32 bits on the wire
+  return ((uint64_t)(uint32_t)groupId << 32) | (uint32_t)controllerId;
+}
+
+std::vector<std::shared_ptr<PixelPusher> > RegistrySnapshot::getGroup(long groupId) const {
   std::vector<std::shared_ptr<PixelPusher> > pusherVector;
-  for(std::map<long, std::shared_ptr<PixelPusher> >::iterator it = mGroupMap.lower_bound(groupId);
-	it != mGroupMap.upper_bound(groupId);
-      ++it) {
-    pusherVector.push_back(it->second);
+  const std::pair<size_t, size_t>* range = groups.find((uint32_t)groupId);
+  if(range != NULL && members[range->first].groupId == groupId) {
+    for(size_t i = range->first; i < range->second; i++) {
+      pusherVector.push_back(members[i].pusher);
+    }
   }
-  mUpdateMutex.unlock();
   return pusherVector;
 }
 
+std::shared_ptr<PixelPusher> RegistrySnapshot::getController(long groupId, long controllerId) const {
+  const size_t* index = controllers.find(packIds(groupId, controllerId));
+  if(index != NULL && members[*index].groupId == groupId && members[*index].controllerId == controllerId) {
+    return members[*index].pusher;
+  }
+  //if no matching PixelPusher is found, return a nullPtr
+  return std::shared_ptr<PixelPusher>();
+}
+
+std::shared_ptr<const RegistrySnapshot> DiscoveryListener::getSnapshot() {
+  return std::atomic_load(&mSnapshot);
+}
+
+std::vector<std::shared_ptr<PixelPusher> > DiscoveryListener::getPushers() {
+  return getSnapshot()->pushers;
+}
+
+std::vector<std::shared_ptr<PixelPusher> > DiscoveryListener::getGroup(long groupId) {
+  return getSnapshot()->getGroup(groupId);
+}
+
 std::shared_ptr<PixelPusher> DiscoveryListener::getController(long groupId, long controllerId) {
-  mUpdateMutex.lock();
-  for(std::map<long, std::shared_ptr<PixelPusher> >::iterator it = mGroupMap.lower_bound(groupId);
-	it != mGroupMap.upper_bound(groupId);
-      ++it) {
-    if(it->second->getControllerId() == controllerId) {
-      mUpdateMutex.unlock();
-      return it->second;
+  return getSnapshot()->getController(groupId, controllerId);
+}
+
+unsigned long DiscoveryListener::getGeneration() {
+  return getSnapshot()->generation;
+}
+
+unsigned long DiscoveryListener::submitGroupFrame(long groupId) {
+  //publish the current strip contents of every controller in the group as one
+  //numbered frame, then wake the senders so they all emit it right away
+  std::vector<std::shared_ptr<PixelPusher> > pushers = getGroup(groupId);
+  mGroupFramesMutex.lock();
+  unsigned long frame = ++mGroupFrames[groupId];
+  long windowMicros = mGroupFrameWindows.count(groupId) ? mGroupFrameWindows[groupId] : 0;
+  mGroupFramesMutex.unlock();
+
+  long long deadlineMicros = 0;
+  if(windowMicros > 0) {
+    deadlineMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() + windowMicros;
+  }
+  for(size_t i = 0; i < pushers.size(); i++) {
+    pushers[i]->submitFrame(frame, deadlineMicros);
+  }
+  SenderEngine* senderEngine = SenderEngine::getInstance();
+  for(size_t i = 0; i < pushers.size(); i++) {
+    senderEngine->expedite(pushers[i].get());
+  }
+  return frame;
+}
+
+long DiscoveryListener::getGroupSkewMicros(long groupId) {
+  //spread between the first and last controller to put the latest group frame
+  //on the wire, or -1 while some controller has not sent it yet
+  std::vector<std::shared_ptr<PixelPusher> > pushers = getGroup(groupId);
+  mGroupFramesMutex.lock();
+  unsigned long frame = mGroupFrames[groupId];
+  mGroupFramesMutex.unlock();
+  if(frame == 0 || pushers.empty()) {
+    return -1;
+  }
+  long long first = 0;
+  long long last = 0;
+  for(size_t i = 0; i < pushers.size(); i++) {
+    if(pushers[i]->getLatchedFrame() != frame) {
+      return -1;
     }
+    long long latchedAt = pushers[i]->getLatchedAtMicros();
+    first = i > 0 ? std::min(first, latchedAt) : latchedAt;
+    last = i > 0 ? std::max(last, latchedAt) : latchedAt;
+  }
+  return (long)(last - first);
+}
+
+void DiscoveryListener::setGroupFrameWindow(long groupId, long windowMicros) {
+  std::lock_guard<std::mutex> lock(mGroupFramesMutex);
+  if(windowMicros > 0) {
+    mGroupFrameWindows[groupId] = windowMicros;
+  }
+  else {
+    mGroupFrameWindows.erase(groupId);
+  }
+}
+
+unsigned long long DiscoveryListener::getGroupMissedFrames(long groupId) {
+  //counts each controller that put a group frame out late, or never because a newer one replaced it
+  std::vector<std::shared_ptr<PixelPusher> > pushers = getGroup(groupId);
+  unsigned long long missed = 0;
+  PusherMetricsSnapshot metrics;
+  for(size_t i = 0; i < pushers.size(); i++) {
+    pushers[i]->getMetrics(metrics);
+    missed += metrics.framesMissed;
+  }
+  return missed;
+}
+
+void DiscoveryListener::getMetrics(PusherMetricsSnapshot& total) {
+  //sums every registered pusher; reads only atomics, so it is fine once per frame
+  std::shared_ptr<const RegistrySnapshot> snapshot = getSnapshot();
+  total = PusherMetricsSnapshot();
+  PusherMetricsSnapshot metrics;
+  for(size_t i = 0; i < snapshot->pushers.size(); i++) {
+    snapshot->pushers[i]->getMetrics(metrics);
+    total.add(metrics);
   }
-  //if no matching PixelPusher is found, return a nullPtr
-  std::shared_ptr<PixelPusher> nullPtr;
-  mUpdateMutex.unlock();
-  return nullPtr;
 }
 
 DiscoveryListener::DiscoveryListener() {
-	mUdpConnection = new ofxUDPManager();
-	bool reuse_buff = 1;
-	mUdpConnection->Create();
-	mUdpConnection->Bind(mPort);
-  ofLogNotice() << "Listening for UDP messages on port " << mPort;
-  mMessageFlag = 0;
-  mIncomingUdpMessage.resize(mIncomingPacketSize + 1);
-  std::fill(mIncomingUdpMessage.begin(), mIncomingUdpMessage.end(), 0);
-  mUdpMessage.resize(mIncomingPacketSize + 1);
-  std::fill(mUdpMessage.begin(), mUdpMessage.end(), 0);
+  mTransport = Transport::create(TRANSPORT_DEFAULT);
+  if(!mTransport || !mTransport->bind(mPort, TransportOptions())) {
+    PP_LOG_ERROR("DiscoveryListener could not bind port %d", mPort);
+  }
+#ifndef TARGET_WIN32
+  if(pipe(mWakePipe) != 0) {
+    mWakePipe[0] = mWakePipe[1] = -1;
+  }
+#endif
+  PP_LOG_NOTICE("Listening for UDP messages on port %d", mPort);
+  mIncomingUdpMessage.assign(mMaxPacketSize, 0);
   
   mAutoThrottle = true;
+  mThrottleType = THROTTLE_AIMD;
+  mTransportType = TRANSPORT_DEFAULT;
+  mPixelFormat = PIXEL_RGB;
   mFrameLimit = 60;
+  mGeneration = 0;
+  std::atomic_store(&mSnapshot, std::shared_ptr<const RegistrySnapshot>(new RegistrySnapshot()));
 
-  mUpdateMapThread = std::thread(&DiscoveryListener::updatePusherMap, this);
+  mRunning = true;
+  mDiscoveryThread = std::thread(&DiscoveryListener::run, this);
 }
 
 DiscoveryListener::~DiscoveryListener() {
-  if(mUpdateMapThread.joinable()) {
-    mUpdateMapThread.join();
+  mRunning = false;
+#ifndef TARGET_WIN32
+  if(mWakePipe[1] >= 0) {
+    char wake = 0;
+    if(write(mWakePipe[1], &wake, 1) < 0) {
+      PP_LOG_WARNING("DiscoveryListener could not wake the discovery thread");
+    }
+  }
+#endif
+  if(mDiscoveryThread.joinable()) {
+    mDiscoveryThread.join();
   }
+  if(mTransport) {
+    mTransport->close();
+  }
+#ifndef TARGET_WIN32
+  if(mWakePipe[0] >= 0) {
+    close(mWakePipe[0]);
+    close(mWakePipe[1]);
+  }
+#endif
 }
 
-void DiscoveryListener::update() {
-  ofLogNotice() << "Updating registry...";
-	/*------------NEED TO UPDATE-----------*/
-  mUdpConnection->Receive(&mIncomingUdpMessage[0], mIncomingPacketSize);
+void DiscoveryListener::run() {
+  //sleep until a beacon arrives or the earliest controller is due to expire
+  while(mRunning) {
+    if(waitForBeacon(getMillisToExpiry(std::chrono::steady_clock::now()))) {
+      update();
+    }
+    expirePushers(std::chrono::steady_clock::now());
+  }
+}
 
-  if(mIncomingPacketSize > 0) {
-    mUpdateMutex.lock();
-    mUdpMessage.clear();
-    ofLogNotice() << "Received packet, processing...";
-    std::copy(mIncomingUdpMessage.begin(), mIncomingUdpMessage.end(), mUdpMessage.begin());
-    DeviceHeader* header;
-    header = new DeviceHeader(&mUdpMessage[0], mIncomingPacketSize);
-    if(header->getDeviceType() != PIXELPUSHER) {
-      //if the device type isn't PixelPusher, end processing it right here.
-      return;
+bool DiscoveryListener::waitForBeacon(int timeoutMillis) {
+#ifdef TARGET_WIN32
+  //OfxUdpTransport can't be polled; update() blocks in receive() for up to a second instead
+  return true;
+#else
+  //a listener that failed to bind has descriptor -1, which poll() skips
+  pollfd fds[2];
+  fds[0].fd = mTransport->getDescriptor();
+  fds[0].events = POLLIN;
+  fds[1].fd = mWakePipe[0];
+  fds[1].events = POLLIN;
+  fds[1].revents = 0;
+  int ready = poll(fds, mWakePipe[0] >= 0 ? 2 : 1, timeoutMillis);
+  if(ready > 0 && (fds[1].revents & POLLIN)) {
+    char wake[16];
+    if(read(mWakePipe[0], wake, sizeof(wake)) < 0) {
+      PP_LOG_WARNING("DiscoveryListener could not drain its wake pipe");
     }
-    
-    std::shared_ptr<PixelPusher> incomingDevice(new PixelPusher(header));
-    std::string macAddress = incomingDevice->getMacAddress();
-    std::string ipAddress = incomingDevice->getIpAddress();
-		mLastSeenMap[macAddress] = std::clock() / CLOCKS_PER_SEC;
+  }
+  return ready > 0 && (fds[0].revents & POLLIN);
+#endif
+}
 
-    if(mPusherMap.count(macAddress) == 0) {
-      //does not already exist in the map
-      addNewPusher(macAddress, incomingDevice);
-      ofLogNotice("", "Adding new PixelPusher %s at address %s", macAddress.c_str(), ipAddress.c_str());
+bool DiscoveryListener::update() {
+  if(!mTransport) {
+    return false;
+  }
+  int received = mTransport->receive(&mIncomingUdpMessage[0], mIncomingUdpMessage.size());
+  if(received <= 0) {
+    return false;
+  }
+
+  //decode on the stack; for a known, unchanged controller that is all we do
+  BeaconView beacon;
+  if(!BeaconView::parse(&mIncomingUdpMessage[0], received, beacon)) {
+    return true;
+  }
+  if(beacon.deviceType != PIXELPUSHER) {
+    //if the device type isn't PixelPusher, end processing it right here.
+    return true;
+  }
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  mUpdateMutex.lock();
+  Registration* known = mPushers.find(beacon.getMacKey());
+  if(known != NULL && known->pusher->getFingerprint() == beacon.getFingerprint()) {
+    //the heap entry is left alone; expirePushers() notices the later deadline
+    known->pusher->updateCounters(beacon);
+    known->deadline = now + std::chrono::milliseconds(known->pusher->getTimeoutMillis());
+    PP_TRACE(TRACE_BEACON, beacon.getMacKey(), beacon.deltaSequence, beacon.updatePeriod);
+    if(mAutoThrottle) {
+      known->pusher->updateThrottle();
     }
-    else {
-      //already exists in the map
-      if(!mPusherMap[macAddress]->isEqual(incomingDevice)) {
-	//if the pushers are not equal, replace it with this one
-	updatePusher(macAddress, incomingDevice);
-	ofLogNotice("", "Updating PixelPusher %s at address %s", macAddress.c_str(), ipAddress.c_str());
-      }
-      else {
-	//if they're the same, then just update it
-	mPusherMap[macAddress]->updateVariables(incomingDevice);
-	ofLogNotice("", "Updating PixelPusher %s at address %s", macAddress.c_str(), ipAddress.c_str());
-	if(incomingDevice->getDeltaSequence() > 3) {
-	  mPusherMap[macAddress]->increaseExtraDelay(5);
-	}
-	if(incomingDevice->getDeltaSequence() < 1) {
-	  mPusherMap[macAddress]->decreaseExtraDelay(1);
-	}
-      }
-    }
-    
     mUpdateMutex.unlock();
+    return true;
   }
+
+  //new or changed controller: build the full objects
+  std::shared_ptr<PixelPusher> incomingDevice(new PixelPusher(new DeviceHeader(beacon)));
+  std::string macAddress = incomingDevice->getMacAddress();
+  std::string ipAddress = incomingDevice->getIpAddress();
+
+  if(known != NULL && !known->pusher->hasSameLayout(incomingDevice)) {
+    //the strips themselves changed, so the old pusher cannot be patched up;
+    //retire it (its sender waits for the worker, so not under the lock) and start over
+    std::shared_ptr<PixelPusher> replaced = known->pusher;
+    mPushers.erase(beacon.getMacKey());
+    mGeneration++;
+    publishSnapshot();
+    mUpdateMutex.unlock();
+    replaced->destroyCardThread();
+    PP_LOG_NOTICE("PixelPusher %s changed its strip layout; replacing it", macAddress.c_str());
+    mUpdateMutex.lock();
+    known = NULL;
+  }
+
+  std::shared_ptr<PixelPusher> moved;
+  if(known == NULL) {
+    addNewPusher(incomingDevice);
+    PP_TRACE(TRACE_PUSHER_ADDED, beacon.getMacKey(), beacon.groupId, beacon.controllerId);
+    PP_LOG_NOTICE("Adding new PixelPusher %s at address %s", macAddress.c_str(), ipAddress.c_str());
+  }
+  else {
+    if(updatePusher(known->pusher, incomingDevice)) {
+      moved = known->pusher;
+    }
+    known->pusher->updateCounters(beacon);
+    //group or controller id may have moved, and the timeout with it
+    applyGroupTimeout(*known);
+    known->deadline = now + std::chrono::milliseconds(known->pusher->getTimeoutMillis());
+    if(known->deadline < known->queued) {
+      enqueue(beacon.getMacKey(), *known);
+    }
+    mGeneration++;
+    publishSnapshot();
+    PP_TRACE(TRACE_PUSHER_UPDATED, beacon.getMacKey(), beacon.groupId, beacon.controllerId);
+    PP_LOG_NOTICE("Updating PixelPusher %s at address %s", macAddress.c_str(), ipAddress.c_str());
+  }
+  
+  mUpdateMutex.unlock();
+  if(moved) {
+    //like the replacement above, the sender and socket work waits for the worker, so not under the lock
+    moved->moveTransport(incomingDevice);
+  }
+  return true;
+}
+
+void DiscoveryListener::setThrottleType(ThrottleType type) {
+  //applies to PixelPushers discovered from now on
+  mUpdateMutex.lock();
+  mThrottleType = type;
+  mUpdateMutex.unlock();
+}
+
+void DiscoveryListener::setTransportType(TransportType type) {
+  //applies to PixelPushers discovered from now on
+  mUpdateMutex.lock();
+  mTransportType = type;
+  mUpdateMutex.unlock();
+}
+
+void DiscoveryListener::setTransportOptions(const TransportOptions& options) {
+  //applies to PixelPushers discovered from now on
+  mUpdateMutex.lock();
+  mTransportOptions = options;
+  mUpdateMutex.unlock();
+}
+
+void DiscoveryListener::setPixelFormat(PixelFormat format) {
+  //applies to PixelPushers discovered from now on
+  mUpdateMutex.lock();
+  mPixelFormat = format;
+  mUpdateMutex.unlock();
+}
+
+void DiscoveryListener::setFrameRecorder(std::shared_ptr<FrameRecorder> recorder) {
+  mUpdateMutex.lock();
+  mFrameRecorder = recorder;
+  mPushers.forEach([&recorder](uint64_t, const Registration& registration) {
+    registration.pusher->setFrameRecorder(recorder);
+  });
+  mUpdateMutex.unlock();
+}
+
+void DiscoveryListener::setAutoThrottle(bool autoThrottle) {
+  mUpdateMutex.lock();
+  mAutoThrottle = autoThrottle;
+  mUpdateMutex.unlock();
+}
+
+void DiscoveryListener::setGroupTimeout(long groupId, long timeoutMillis) {
+  //timeoutMillis <= 0 restores PixelPusher::sDefaultTimeoutMillis
+  mUpdateMutex.lock();
+  if(timeoutMillis > 0) {
+    mGroupTimeouts[groupId] = timeoutMillis;
+  }
+  else {
+    mGroupTimeouts.erase(groupId);
+  }
+  mPushers.forEach([this, groupId](uint64_t macKey, Registration& registration) {
+    if(registration.pusher->getGroupId() != groupId) {
+      return;
+    }
+    applyGroupTimeout(registration);
+    std::chrono::steady_clock::time_point lastSeen(std::chrono::microseconds(registration.pusher->getBeaconStats().lastSeenMicros));
+    registration.deadline = lastSeen + std::chrono::milliseconds(registration.pusher->getTimeoutMillis());
+    if(registration.deadline < registration.queued) {
+      enqueue(macKey, registration);
+    }
+  });
+  mUpdateMutex.unlock();
+#ifndef TARGET_WIN32
+  //let the discovery thread recompute its poll() timeout
+  if(mWakePipe[1] >= 0) {
+    char wake = 0;
+    if(write(mWakePipe[1], &wake, 1) < 0) {
+      PP_LOG_WARNING("DiscoveryListener could not wake the discovery thread");
+    }
+  }
+#endif
+}
+
+void DiscoveryListener::applyGroupTimeout(Registration& registration) {
+  std::map<long, long>::iterator timeout = mGroupTimeouts.find(registration.pusher->getGroupId());
+  registration.pusher->setTimeoutMillis(timeout != mGroupTimeouts.end() ? timeout->second : PixelPusher::sDefaultTimeoutMillis);
 }
 
-void DiscoveryListener::addNewPusher(std::string macAddress, std::shared_ptr<PixelPusher> pusher) {
-  mPusherMap.insert(std::make_pair(macAddress, pusher));
-  mGroupMap.insert(std::make_pair(pusher->getGroupId(), pusher));
+void DiscoveryListener::enqueue(uint64_t macKey, Registration& registration) {
+  //supersedes any entry already queued for this pusher
+  Expiry expiry;
+  expiry.deadline = registration.deadline;
+  expiry.macKey = macKey;
+  registration.queued = registration.deadline;
+  mExpiryHeap.push_back(expiry);
+  std::push_heap(mExpiryHeap.begin(), mExpiryHeap.end(), std::greater<Expiry>());
+}
+
+void DiscoveryListener::addNewPusher(std::shared_ptr<PixelPusher> pusher) {
+  pusher->setThrottleController(ThrottleController::create(mThrottleType));
+  pusher->setTransport(Transport::create(mTransportType), mTransportOptions);
+  pusher->setPixelFormat(mPixelFormat);
+  pusher->setFrameRecorder(mFrameRecorder);
+  Registration registration;
+  registration.pusher = pusher;
+  applyGroupTimeout(registration);
+  registration.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(pusher->getTimeoutMillis());
+  enqueue(pusher->getMacKey(), registration);
+  mPushers.insert(pusher->getMacKey(), registration);
   pusher->createCardThread();
+  mGeneration++;
+  publishSnapshot();
 }
 
-void DiscoveryListener::updatePusher(std::string macAddress, std::shared_ptr<PixelPusher> pusher) {
-  mPusherMap[macAddress]->copyHeader(pusher);
+bool DiscoveryListener::updatePusher(std::shared_ptr<PixelPusher> known, std::shared_ptr<PixelPusher> pusher) {
+  return known->copyHeader(pusher);
 }
 
-void DiscoveryListener::updatePusherMap() {
-  mRunUpdateMapThread = true;
-  while(mRunUpdateMapThread) {
-    mUpdateMutex.lock();
-    for(std::map<std::string, std::shared_ptr<PixelPusher> >::iterator pusher = mPusherMap.begin(); pusher != mPusherMap.end();) {
-			//pusher->first is Mac Address, pusher->second is the shared pointer to the PixelPusher
-      if(!pusher->second->isAlive()) {
-				ofLogNotice("", "DiscoveryListener removing PixelPusher %s from all maps.", pusher->first.c_str());
-				pusher->second->destroyCardThread();
-				//remove pusher from maps
-				mLastSeenMap.erase(pusher->first);
-				mPusherMap.erase(pusher++);
-      }
-      else {
-				++pusher;
-      }
+int DiscoveryListener::getMillisToExpiry(std::chrono::steady_clock::time_point now) {
+  //-1 blocks poll() until the next beacon when nothing is registered
+  if(mExpiryHeap.empty()) {
+    return -1;
+  }
+  std::chrono::steady_clock::duration remaining = mExpiryHeap.front().deadline - now;
+  if(remaining <= std::chrono::steady_clock::duration::zero()) {
+    return 0;
+  }
+  //round up so we never wake just short of the deadline and spin
+  std::chrono::milliseconds millis = std::chrono::duration_cast<std::chrono::milliseconds>(remaining);
+  if(millis < remaining) {
+    millis += std::chrono::milliseconds(1);
+  }
+  return (int)millis.count();
+}
+
+void DiscoveryListener::expirePushers(std::chrono::steady_clock::time_point now) {
+  std::vector<std::shared_ptr<PixelPusher> > expired;
+  mUpdateMutex.lock();
+  while(!mExpiryHeap.empty() && mExpiryHeap.front().deadline <= now) {
+    std::pop_heap(mExpiryHeap.begin(), mExpiryHeap.end(), std::greater<Expiry>());
+    Expiry expiry = mExpiryHeap.back();
+    mExpiryHeap.pop_back();
+    Registration* registration = mPushers.find(expiry.macKey);
+    if(registration == NULL || registration->queued != expiry.deadline) {
+      continue;
     }
-    mUpdateMutex.unlock();
-    this_thread::sleep_for(std::chrono::milliseconds(1000));
-  }  
+    if(registration->deadline > now) {
+      //heard from since this entry was queued: requeue at the newer deadline
+      enqueue(expiry.macKey, *registration);
+      continue;
+    }
+    PP_LOG_NOTICE("DiscoveryListener removing PixelPusher %s from all maps.", registration->pusher->getMacAddress().c_str());
+    PP_TRACE(TRACE_PUSHER_EXPIRED, expiry.macKey,
+             std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() - registration->pusher->getBeaconStats().lastSeenMicros,
+             registration->pusher->getTimeoutMillis());
+    expired.push_back(registration->pusher);
+    mPushers.erase(expiry.macKey);
+  }
+  if(!expired.empty()) {
+    mGeneration++;
+    publishSnapshot();
+  }
+  mUpdateMutex.unlock();
+
+  //stopping a sender waits for its worker, so do it without holding the registry
+  for(size_t i = 0; i < expired.size(); i++) {
+    expired[i]->destroyCardThread();
+  }
+}
+
+static bool macLess(const std::shared_ptr<PixelPusher>& a, const std::shared_ptr<PixelPusher>& b) {
+  return a->getMacKey() < b->getMacKey();
+}
+
+void DiscoveryListener::publishSnapshot() {
+  //called with mUpdateMutex held; readers pick the new snapshot up on their next load
+  std::shared_ptr<RegistrySnapshot> snapshot(new RegistrySnapshot());
+  snapshot->generation = mGeneration;
+  snapshot->pushers.reserve(mPushers.size());
+  mPushers.forEach([&snapshot](uint64_t, const Registration& registration) {
+    snapshot->pushers.push_back(registration.pusher);
+  });
+  std::sort(snapshot->pushers.begin(), snapshot->pushers.end(), macLess);
+
+  std::vector<RegistrySnapshot::Member>& members = snapshot->members;
+  members.reserve(snapshot->pushers.size());
+  for(size_t i = 0; i < snapshot->pushers.size(); i++) {
+    RegistrySnapshot::Member member;
+    member.groupId = snapshot->pushers[i]->getGroupId();
+    member.controllerId = snapshot->pushers[i]->getControllerId();
+    member.pusher = snapshot->pushers[i];
+    members.push_back(member);
+  }
+  std::stable_sort(members.begin(), members.end(), memberLess);
+
+  snapshot->controllers.reserve(members.size());
+  for(size_t i = 0; i < members.size(); i++) {
+    uint64_t ids = RegistrySnapshot::packIds(members[i].groupId, members[i].controllerId);
+    //duplicate ids resolve to the lowest MAC, as getController always has
+    if(snapshot->controllers.find(ids) == NULL) {
+      snapshot->controllers.insert(ids, i);
+    }
+    if(i == 0 || members[i - 1].groupId != members[i].groupId) {
+      snapshot->groups.insert((uint32_t)members[i].groupId, std::make_pair(i, i + 1));
+    }
+    else {
+      snapshot->groups.find((uint32_t)members[i].groupId)->second = i + 1;
+    }
+  }
+  std::atomic_store(&mSnapshot, std::shared_ptr<const RegistrySnapshot>(snapshot));
 }
@@ -16,44 +16,131 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
-#include <ctime>
+#include <atomic>
+#include <vector>
 
 #ifdef TARGET_WIN32
 #include "sdfWindows.hpp"
 #include "sdfServerSocket.hpp"
 #endif
 
-#include "ofLog.h"
 #include "PixelPusher.h"
+#include "FlatIndex.h"
+
+/*
+ * An immutable view of the registered PixelPushers.  The discovery thread
+ * builds a new one whenever a pusher is added, changed or expires and swaps
+ * it in atomically, so readers never wait on discovery; a reader can keep
+ * using the snapshot it holds for as long as it likes.
+ */
+struct RegistrySnapshot {
+  struct Member {
+    long groupId;
+    long controllerId;
+    std::shared_ptr<PixelPusher> pusher;
+  };
+  RegistrySnapshot() : generation(0) {}
+  static uint64_t packIds(long groupId, long controllerId);
+  std::vector<std::shared_ptr<PixelPusher> > getGroup(long groupId) const;
+  std::shared_ptr<PixelPusher> getController(long groupId, long controllerId) const;
+  unsigned long generation;
+  // every pusher, in MAC order
+  std::vector<std::shared_ptr<PixelPusher> > pushers;
+  // the same pushers sorted by group, then controller
+  std::vector<Member> members;
+  // packed (group, controller) -> index into members
+  FlatIndex<size_t> controllers;
+  // group -> [first, last) range of members
+  FlatIndex<std::pair<size_t, size_t> > groups;
+};
 
 class DiscoveryListener {
  public:
   static DiscoveryListener* getInstance();
   void freeInstance();
   int getFrameLimit();
+  std::shared_ptr<const RegistrySnapshot> getSnapshot();
   std::vector<std::shared_ptr<PixelPusher> > getPushers();
   std::vector<std::shared_ptr<PixelPusher> > getGroup(long groupId);
   std::shared_ptr<PixelPusher> getController(long groupId, long controllerId);
+  unsigned long getGeneration();
+  unsigned long submitGroupFrame(long groupId);
+  long getGroupSkewMicros(long groupId);
+  // every controller must have a group frame on the wire this long after submitGroupFrame(); 0 means no window
+  void setGroupFrameWindow(long groupId, long windowMicros);
+  unsigned long long getGroupMissedFrames(long groupId);
+  void getMetrics(PusherMetricsSnapshot& total);
+  void setThrottleType(ThrottleType type);
+  void setAutoThrottle(bool autoThrottle);
+  // socket backend and tuning for PixelPushers discovered from now on
+  void setTransportType(TransportType type);
+  void setTransportOptions(const TransportOptions& options);
+  // strip format for PixelPushers discovered from now on, unless their strip flags say RGBOW or wide pixels
+  void setPixelFormat(PixelFormat format);
+  // records what every pusher, current and future, sends; an empty pointer stops
+  void setFrameRecorder(std::shared_ptr<FrameRecorder> recorder);
+  void setGroupTimeout(long groupId, long timeoutMillis);
  private:
   DiscoveryListener();
   ~DiscoveryListener();
-  void update();
-  void addNewPusher(std::string macAddress, std::shared_ptr<PixelPusher> pusher);
-  void updatePusher(std::string macAddress, std::shared_ptr<PixelPusher> pusher);
-  void updatePusherMap();
+  // one registered pusher and the time its next beacon is due by
+  struct Registration {
+    std::shared_ptr<PixelPusher> pusher;
+    std::chrono::steady_clock::time_point deadline;
+    // deadline of this pusher's live heap entry; others are stale
+    std::chrono::steady_clock::time_point queued;
+  };
+  // entry of the expiry heap; may be older than the registration's deadline
+  struct Expiry {
+    std::chrono::steady_clock::time_point deadline;
+    uint64_t macKey;
+    bool operator>(const Expiry& other) const {
+      return deadline > other.deadline;
+    }
+  };
+  void run();
+  bool waitForBeacon(int timeoutMillis);
+  bool update();
+  void addNewPusher(std::shared_ptr<PixelPusher> pusher);
+  bool updatePusher(std::shared_ptr<PixelPusher> known, std::shared_ptr<PixelPusher> pusher);
+  void applyGroupTimeout(Registration& registration);
+  void enqueue(uint64_t macKey, Registration& registration);
+  int getMillisToExpiry(std::chrono::steady_clock::time_point now);
+  void expirePushers(std::chrono::steady_clock::time_point now);
+  void publishSnapshot();
   static DiscoveryListener* mDiscoveryService;
-	ofxUDPManager* mUdpConnection;
-  int mMessageFlag;
-  std::vector<char> mIncomingUdpMessage;
-  std::vector<unsigned char> mUdpMessage;
-  static const int mIncomingPacketSize = 76;
+  // bound to mPort for beacons
+  std::shared_ptr<Transport> mTransport;
+#ifndef TARGET_WIN32
+  // written to by the destructor to interrupt poll()
+  int mWakePipe[2];
+#endif
+  std::vector<unsigned char> mIncomingUdpMessage;
+  // beacons are 76 bytes for up to 8 strips and grow with the strip flags
+  static const int mMaxPacketSize = 1500;
   static const int mPort = 7331;
   bool mAutoThrottle;
-  bool mRunUpdateMapThread;
+  ThrottleType mThrottleType;
+  TransportType mTransportType;
+  TransportOptions mTransportOptions;
+  PixelFormat mPixelFormat;
+  std::shared_ptr<FrameRecorder> mFrameRecorder;
+  std::atomic<bool> mRunning;
   int mFrameLimit;
-  std::map<std::string, std::shared_ptr<PixelPusher> > mPusherMap;
-  std::map<std::string, long> mLastSeenMap;
-  std::multimap<long, std::shared_ptr<PixelPusher> > mGroupMap;
-  std::thread mUpdateMapThread;
+  // bumped whenever a pusher is added, changed or expires
+  unsigned long mGeneration;
+  // only touched through std::atomic_load / std::atomic_store
+  std::shared_ptr<const RegistrySnapshot> mSnapshot;
+  // registered pushers keyed by packed MAC (BeaconView::getMacKey)
+  FlatIndex<Registration> mPushers;
+  // min-heap of deadlines, touched only by the discovery thread
+  std::vector<Expiry> mExpiryHeap;
+  // per-group overrides of PixelPusher::sDefaultTimeoutMillis
+  std::map<long, long> mGroupTimeouts;
+  // last frame number submitted to each group
+  std::map<long, unsigned long> mGroupFrames;
+  std::map<long, long> mGroupFrameWindows;
+  std::mutex mGroupFramesMutex;
+  std::thread mDiscoveryThread;
   std::mutex mUpdateMutex;
 };
@@ -0,0 +1,156 @@
+/*
+ * FlatIndex
+ *
+ * A small open-addressing hash table keyed by 64-bit integers, used for the
+ * packed MAC and (group, controller) lookups.  Slots live in one flat array
+ * and are probed linearly; erase shifts the rest of the probe run back
+ * instead of leaving tombstones, so lookups stay short and never allocate.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+template <class Value>
+class FlatIndex {
+ public:
+  FlatIndex() : mSlots(sMinCapacity), mSize(0) {}
+
+  size_t size() const {
+    return mSize;
+  }
+
+  bool empty() const {
+    return mSize == 0;
+  }
+
+  void clear() {
+    mSlots.assign(sMinCapacity, Slot());
+    mSize = 0;
+  }
+
+  void reserve(size_t count) {
+    size_t capacity = mSlots.size();
+    while(capacity < count * 2) {
+      capacity *= 2;
+    }
+    if(capacity != mSlots.size()) {
+      rehash(capacity);
+    }
+  }
+
+  Value* find(uint64_t key) {
+    size_t mask = mSlots.size() - 1;
+    for(size_t i = home(key);; i = (i + 1) & mask) {
+      if(!mSlots[i].used) {
+        return NULL;
+      }
+      if(mSlots[i].key == key) {
+        return &mSlots[i].value;
+      }
+    }
+  }
+
+  const Value* find(uint64_t key) const {
+    return const_cast<FlatIndex*>(this)->find(key);
+  }
+
+  //inserts, or replaces the value already stored under key
+  void insert(uint64_t key, const Value& value) {
+    if((mSize + 1) * 2 > mSlots.size()) {
+      rehash(mSlots.size() * 2);
+    }
+    size_t mask = mSlots.size() - 1;
+    size_t i = home(key);
+    while(mSlots[i].used && mSlots[i].key != key) {
+      i = (i + 1) & mask;
+    }
+    if(!mSlots[i].used) {
+      mSlots[i].used = true;
+      mSlots[i].key = key;
+      mSize++;
+    }
+    mSlots[i].value = value;
+  }
+
+  bool erase(uint64_t key) {
+    size_t mask = mSlots.size() - 1;
+    size_t hole = home(key);
+    while(mSlots[hole].used && mSlots[hole].key != key) {
+      hole = (hole + 1) & mask;
+    }
+    if(!mSlots[hole].used) {
+      return false;
+    }
+    //pull back every later entry of the run that may legally sit in the hole
+    for(size_t next = (hole + 1) & mask; mSlots[next].used; next = (next + 1) & mask) {
+      size_t wanted = home(mSlots[next].key);
+      bool movable = hole <= next ? (wanted <= hole || wanted > next) : (wanted <= hole && wanted > next);
+      if(movable) {
+        mSlots[hole] = mSlots[next];
+        hole = next;
+      }
+    }
+    mSlots[hole] = Slot();
+    mSize--;
+    return true;
+  }
+
+  template <class Function>
+  void forEach(Function function) {
+    for(size_t i = 0; i < mSlots.size(); i++) {
+      if(mSlots[i].used) {
+        function(mSlots[i].key, mSlots[i].value);
+      }
+    }
+  }
+
+  template <class Function>
+  void forEach(Function function) const {
+    for(size_t i = 0; i < mSlots.size(); i++) {
+      if(mSlots[i].used) {
+        function(mSlots[i].key, mSlots[i].value);
+      }
+    }
+  }
+
+ private:
+  struct Slot {
+    Slot() : key(0), used(false), value() {}
+    uint64_t key;
+    bool used;
+    Value value;
+  };
+
+  static const size_t sMinCapacity = 16;
+
+  static uint64_t mix(uint64_t key) {
+    //murmur3 finalizer; MACs share their vendor prefix, so spread the low bits
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+  }
+
+  size_t home(uint64_t key) const {
+    return (size_t)mix(key) & (mSlots.size() - 1);
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<Slot> old(capacity);
+    old.swap(mSlots);
+    mSize = 0;
+    for(size_t i = 0; i < old.size(); i++) {
+      if(old[i].used) {
+        insert(old[i].key, old[i].value);
+      }
+    }
+  }
+
+  std::vector<Slot> mSlots;
+  size_t mSize;
+};
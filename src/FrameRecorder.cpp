@@ -0,0 +1,190 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "FrameRecorder.h"
+#include "PixelPusher.h"
+#include "PixelPusherLog.h"
+#include <chrono>
+#include <cstring>
+
+static_assert(sizeof(FrameLogHeader) == 16, "FrameLogHeader must stay 16 bytes");
+static_assert(sizeof(FrameRecord) == 32, "FrameRecord must stay 32 bytes");
+
+const char FrameRecorder::sMagic[8] = { 'P', 'P', 'F', 'R', 'A', 'M', 'E', 'S' };
+
+//records queued for the writer thread before new ones are dropped
+static const size_t sQueueBytes = 4 << 20;
+
+FrameRecorder::FrameRecorder() {
+  mRunning = false;
+  mFile = NULL;
+  mStripsFrames = 0;
+  mRecordCount = 0;
+  mDroppedRecords = 0;
+  mBytesWritten = 0;
+}
+
+FrameRecorder::~FrameRecorder() {
+  close();
+}
+
+bool FrameRecorder::open(const std::string& path) {
+  close();
+  std::lock_guard<std::mutex> lock(mMutex);
+  //"ab+" so an existing log's header can be checked before anything is appended
+  mFile = fopen(path.c_str(), "ab+");
+  if(mFile == NULL) {
+    PP_LOG_ERROR("FrameRecorder could not open %s", path.c_str());
+    return false;
+  }
+  fseek(mFile, 0, SEEK_END);
+  FrameLogHeader header;
+  if(ftell(mFile) == 0) {
+    memcpy(header.magic, sMagic, sizeof(header.magic));
+    header.version = FrameLogHeader::sVersion;
+    header.byteOrder = FrameLogHeader::sByteOrderMark;
+    fwrite(&header, sizeof(header), 1, mFile);
+    mBytesWritten += sizeof(header);
+  }
+  else {
+    //records appended to another version, byte order or file would make the whole log unreadable
+    fseek(mFile, 0, SEEK_SET);
+    bool valid = fread(&header, sizeof(header), 1, mFile) == 1 &&
+      memcmp(header.magic, sMagic, sizeof(header.magic)) == 0 &&
+      header.version == FrameLogHeader::sVersion &&
+      header.byteOrder == FrameLogHeader::sByteOrderMark;
+    if(!valid) {
+      PP_LOG_ERROR("FrameRecorder: %s is not a frame log this build can append to", path.c_str());
+      fclose(mFile);
+      mFile = NULL;
+      return false;
+    }
+    fseek(mFile, 0, SEEK_END);
+  }
+  //reserved once, so queueing a record never allocates
+  mPending.reserve(sQueueBytes);
+  mWriting.reserve(sQueueBytes);
+  mRunning = true;
+  mWriter = std::thread(&FrameRecorder::run, this);
+  return true;
+}
+
+void FrameRecorder::close() {
+  //the writer drains the queue before it exits
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRunning = false;
+  }
+  mWake.notify_one();
+  if(mWriter.joinable()) {
+    mWriter.join();
+  }
+  std::lock_guard<std::mutex> lock(mMutex);
+  if(mFile != NULL) {
+    fclose(mFile);
+    mFile = NULL;
+  }
+}
+
+bool FrameRecorder::isOpen() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mFile != NULL;
+}
+
+void FrameRecorder::record(int64_t timeMicros, uint64_t macKey, uint32_t frameId, int stripNumber, PixelFormat format, FrameRecordSource source, const unsigned char* data, int length) {
+  static const unsigned char padding[8] = { 0 };
+  const PixelFormatSpec& spec = getPixelFormatSpec(format);
+  FrameRecord record;
+  record.timeMicros = timeMicros;
+  record.macKey = macKey;
+  record.frameId = frameId;
+  record.length = (uint32_t)length;
+  record.stripNumber = (uint16_t)stripNumber;
+  record.format = (uint8_t)spec.format;
+  record.source = (uint8_t)source;
+  record.channels = (uint8_t)(source == FRAME_SOURCE_WIRE ? spec.wireBytes : spec.channels);
+  memset(record.reserved, 0, sizeof(record.reserved));
+  size_t pad = (8 - (length & 7)) & 7;
+  size_t bytes = sizeof(record) + length + pad;
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  if(!mRunning || mFile == NULL) {
+    return;
+  }
+  if(mPending.size() + bytes > sQueueBytes) {
+    mDroppedRecords++;
+    return;
+  }
+  bool wasEmpty = mPending.empty();
+  const unsigned char* header = reinterpret_cast<const unsigned char*>(&record);
+  mPending.insert(mPending.end(), header, header + sizeof(record));
+  mPending.insert(mPending.end(), data, data + length);
+  mPending.insert(mPending.end(), padding, padding + pad);
+  mRecordCount++;
+  lock.unlock();
+  if(wasEmpty) {
+    mWake.notify_one();
+  }
+}
+
+void FrameRecorder::run() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  while(true) {
+    while(mPending.empty() && mRunning) {
+      mWake.wait(lock);
+    }
+    if(mPending.empty()) {
+      return;
+    }
+    mWriting.swap(mPending);
+    FILE* file = mFile;
+    lock.unlock();
+    //records are appended whole, so a log cut short ends in at most one torn record; FrameReplayer drops it
+    bool written = file != NULL && fwrite(&mWriting[0], 1, mWriting.size(), file) == mWriting.size();
+    lock.lock();
+    if(written) {
+      mBytesWritten += mWriting.size();
+    }
+    else if(mFile != NULL) {
+      PP_LOG_ERROR("FrameRecorder write failed; closing the log");
+      fclose(mFile);
+      mFile = NULL;
+      mPending.clear();
+    }
+    mWriting.clear();
+  }
+}
+
+void FrameRecorder::recordStrips(PixelPusher& pusher) {
+  int64_t now = getTimeMicros();
+  std::deque<std::shared_ptr<Strip> > strips = pusher.getStrips();
+  uint32_t frameId;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    frameId = ++mStripsFrames;
+  }
+  for(size_t i = 0; i < strips.size(); i++) {
+    PixelView view = strips[i]->getPixelView();
+    record(now, pusher.getMacKey(), frameId, strips[i]->getStripNumber(), strips[i]->getPixelFormat(), FRAME_SOURCE_APP, view.data, view.size());
+  }
+}
+
+unsigned long long FrameRecorder::getRecordCount() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mRecordCount;
+}
+
+unsigned long long FrameRecorder::getDroppedRecords() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mDroppedRecords;
+}
+
+unsigned long long FrameRecorder::getBytesWritten() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mBytesWritten;
+}
+
+int64_t FrameRecorder::getTimeMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,97 @@
+/*
+ * FrameRecorder
+ *
+ * Appends pixel data to a binary frame log for show playback and repeatable
+ * performance runs.  A log is a FrameLogHeader followed by records, each a
+ * FrameRecord and its pixel bytes padded to 8 bytes, so FrameReplayer can
+ * map the file and read records in place.  Records can hold what the app
+ * wrote to the strips (recordStrips(), before publish()) or what the sender
+ * put on the wire (PixelPusher::setFrameRecorder()).  Fields are in host
+ * byte order; the header's byte order mark tells a foreign log apart.
+ *
+ * record() only copies into a bounded queue; a writer thread owns the file.
+ * When the writer falls behind, records are dropped and counted rather than
+ * stalling the sender.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdio>
+#include <stdint.h>
+#include "PixelFormat.h"
+
+class PixelPusher;
+
+enum FrameRecordSource {
+  // channel buffers as the app left them; pre power scale, channels per pixel as the strip has them
+  FRAME_SOURCE_APP,
+  // strip payloads as sent, wire bytes per pixel of the strip's format
+  FRAME_SOURCE_WIRE
+};
+
+struct FrameLogHeader {
+  static const uint32_t sVersion = 2;
+  static const uint32_t sByteOrderMark = 0x01020304;
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+};
+
+struct FrameRecord {
+  // steady clock, when the frame was taken
+  int64_t timeMicros;
+  // packed MAC, as PixelPusher::getMacKey()
+  uint64_t macKey;
+  // counts up per pusher and source; records sharing (macKey, frameId) form one frame however they interleave
+  uint32_t frameId;
+  // pixel bytes that follow, before padding
+  uint32_t length;
+  uint16_t stripNumber;
+  // a PixelFormat
+  uint8_t format;
+  uint8_t source;
+  // bytes per pixel in the payload
+  uint8_t channels;
+  uint8_t reserved[3];
+};
+
+class FrameRecorder {
+ public:
+  static const char sMagic[8];
+  FrameRecorder();
+  ~FrameRecorder();
+  // appends to an existing log, or starts a new one; fails on a file that is
+  // not a log of this version and byte order
+  bool open(const std::string& path);
+  void close();
+  bool isOpen();
+  void record(int64_t timeMicros, uint64_t macKey, uint32_t frameId, int stripNumber, PixelFormat format, FrameRecordSource source, const unsigned char* data, int length);
+  // every strip's write buffer as one frame; call before pusher.publish()
+  void recordStrips(PixelPusher& pusher);
+  unsigned long long getRecordCount();
+  // records that did not fit the queue while the writer was behind
+  unsigned long long getDroppedRecords();
+  unsigned long long getBytesWritten();
+  static int64_t getTimeMicros();
+ private:
+  void run();
+  // several sender workers can record at once
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  std::thread mWriter;
+  bool mRunning;
+  FILE* mFile;
+  // records waiting for the writer, which swaps this with mWriting so both keep their capacity
+  std::vector<unsigned char> mPending;
+  std::vector<unsigned char> mWriting;
+  // frame ids handed out by recordStrips()
+  uint32_t mStripsFrames;
+  unsigned long long mRecordCount;
+  unsigned long long mDroppedRecords;
+  unsigned long long mBytesWritten;
+};
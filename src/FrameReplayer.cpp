@@ -0,0 +1,255 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "FrameReplayer.h"
+#include "DiscoveryListener.h"
+#include "PixelPusherLog.h"
+#include <algorithm>
+#include <cstring>
+
+#ifndef TARGET_WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static size_t recordSize(const FrameRecord& record) {
+  return sizeof(FrameRecord) + ((record.length + 7) & ~(size_t)7);
+}
+
+static bool sameFrame(const FrameRecord& a, const FrameRecord& b) {
+  return a.frameId == b.frameId && a.source == b.source;
+}
+
+static bool macLess(const std::shared_ptr<PixelPusher>& pusher, uint64_t macKey) {
+  return pusher->getMacKey() < macKey;
+}
+
+FrameReplayer::FrameReplayer() {
+  mData = NULL;
+  mSize = 0;
+  mNextFrame = 0;
+  mGeneration = 0;
+  mUnmatchedRecords = 0;
+}
+
+FrameReplayer::~FrameReplayer() {
+  close();
+}
+
+#ifdef TARGET_WIN32
+
+bool FrameReplayer::open(const std::string& path) {
+  PP_LOG_ERROR("FrameReplayer needs mmap");
+  return false;
+}
+
+void FrameReplayer::close() {
+}
+
+#else
+
+bool FrameReplayer::open(const std::string& path) {
+  close();
+  int descriptor = ::open(path.c_str(), O_RDONLY);
+  if(descriptor < 0) {
+    PP_LOG_ERROR("FrameReplayer could not open %s", path.c_str());
+    return false;
+  }
+  struct stat info;
+  if(fstat(descriptor, &info) != 0 || (size_t)info.st_size < sizeof(FrameLogHeader)) {
+    PP_LOG_ERROR("FrameReplayer: %s is not a frame log", path.c_str());
+    ::close(descriptor);
+    return false;
+  }
+  void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  //the mapping keeps the file alive on its own
+  ::close(descriptor);
+  if(data == MAP_FAILED) {
+    PP_LOG_ERROR("FrameReplayer could not map %s", path.c_str());
+    return false;
+  }
+  mData = static_cast<const unsigned char*>(data);
+  mSize = info.st_size;
+  madvise(data, mSize, MADV_SEQUENTIAL);
+
+  const FrameLogHeader* header = reinterpret_cast<const FrameLogHeader*>(mData);
+  if(memcmp(header->magic, FrameRecorder::sMagic, sizeof(header->magic)) != 0 || header->version != FrameLogHeader::sVersion || header->byteOrder != FrameLogHeader::sByteOrderMark) {
+    PP_LOG_ERROR("FrameReplayer: %s is not a frame log this build can read", path.c_str());
+    close();
+    return false;
+  }
+
+  //walk the record headers only; a record cut short by a crash ends the log
+  std::vector<size_t> offsets;
+  size_t offset = sizeof(FrameLogHeader);
+  while(offset + sizeof(FrameRecord) <= mSize) {
+    const FrameRecord* record = reinterpret_cast<const FrameRecord*>(mData + offset);
+    if(offset + recordSize(*record) > mSize) {
+      break;
+    }
+    offsets.push_back(offset);
+    offset += recordSize(*record);
+  }
+  buildFrames(offsets);
+  if(offset != mSize) {
+    PP_LOG_WARNING("FrameReplayer: ignoring %lu bytes of a torn record at the end of %s", (unsigned long)(mSize - offset), path.c_str());
+  }
+  PP_LOG_NOTICE("FrameReplayer opened %s: %lu frames", path.c_str(), (unsigned long)getFrameCount());
+  return true;
+}
+
+void FrameReplayer::close() {
+  if(mData != NULL) {
+    munmap(const_cast<unsigned char*>(mData), mSize);
+  }
+  mData = NULL;
+  mSize = 0;
+  mRecords.clear();
+  mFrames.clear();
+  mNextFrame = 0;
+  mTargets.clear();
+}
+
+#endif
+
+void FrameReplayer::buildFrames(const std::vector<size_t>& offsets) {
+  //first gather each pusher frame's records; a pusher's records for one frame are
+  //contiguous in its own stream, so a new frame id for a MAC closes its previous frame
+  struct PusherFrame {
+    uint64_t macKey;
+    std::vector<size_t> records;
+  };
+  std::vector<PusherFrame> pusherFrames;
+  FlatIndex<size_t> open;
+  for(size_t i = 0; i < offsets.size(); i++) {
+    const FrameRecord* record = reinterpret_cast<const FrameRecord*>(mData + offsets[i]);
+    const size_t* current = open.find(record->macKey);
+    if(current == NULL || !sameFrame(*reinterpret_cast<const FrameRecord*>(mData + pusherFrames[*current].records.front()), *record)) {
+      PusherFrame pusherFrame;
+      pusherFrame.macKey = record->macKey;
+      pusherFrames.push_back(pusherFrame);
+      open.insert(record->macKey, pusherFrames.size() - 1);
+      current = open.find(record->macKey);
+    }
+    pusherFrames[*current].records.push_back(offsets[i]);
+  }
+
+  //then lay them out in steps, starting a new step when a pusher would show up twice
+  std::vector<uint64_t> stepMacs;
+  mRecords.reserve(offsets.size());
+  for(size_t i = 0; i < pusherFrames.size(); i++) {
+    if(mFrames.empty() || std::find(stepMacs.begin(), stepMacs.end(), pusherFrames[i].macKey) != stepMacs.end()) {
+      mFrames.push_back(mRecords.size());
+      stepMacs.clear();
+    }
+    stepMacs.push_back(pusherFrames[i].macKey);
+    mRecords.insert(mRecords.end(), pusherFrames[i].records.begin(), pusherFrames[i].records.end());
+  }
+  mFrames.push_back(mRecords.size());
+}
+
+bool FrameReplayer::isOpen() {
+  return mData != NULL;
+}
+
+size_t FrameReplayer::getFrameCount() {
+  return mFrames.empty() ? 0 : mFrames.size() - 1;
+}
+
+size_t FrameReplayer::getRecordCount() {
+  return mRecords.size();
+}
+
+long long FrameReplayer::getDurationMicros() {
+  if(getFrameCount() == 0) {
+    return 0;
+  }
+  const FrameRecord* first = reinterpret_cast<const FrameRecord*>(mData + mRecords[mFrames.front()]);
+  const FrameRecord* last = reinterpret_cast<const FrameRecord*>(mData + mRecords[mFrames[mFrames.size() - 2]]);
+  return last->timeMicros - first->timeMicros;
+}
+
+long long FrameReplayer::getNextFrameMicros() {
+  if(mNextFrame >= getFrameCount()) {
+    return -1;
+  }
+  const FrameRecord* first = reinterpret_cast<const FrameRecord*>(mData + mRecords[mFrames.front()]);
+  const FrameRecord* next = reinterpret_cast<const FrameRecord*>(mData + mRecords[mFrames[mNextFrame]]);
+  return next->timeMicros - first->timeMicros;
+}
+
+void FrameReplayer::rewind() {
+  mNextFrame = 0;
+}
+
+unsigned long long FrameReplayer::getUnmatchedRecords() {
+  return mUnmatchedRecords;
+}
+
+const FrameReplayer::Target& FrameReplayer::resolve(const RegistrySnapshot& snapshot, const FrameRecord& record) {
+  //registry changes invalidate every cached strip
+  if(snapshot.generation != mGeneration) {
+    mTargets.clear();
+    mGeneration = snapshot.generation;
+  }
+  uint64_t key = (record.macKey << 16) | record.stripNumber;
+  const Target* cached = mTargets.find(key);
+  if(cached != NULL) {
+    return *cached;
+  }
+  //misses are cached too, as an empty target
+  Target target;
+  std::vector<std::shared_ptr<PixelPusher> >::const_iterator found = std::lower_bound(snapshot.pushers.begin(), snapshot.pushers.end(), record.macKey, macLess);
+  if(found != snapshot.pushers.end() && (*found)->getMacKey() == record.macKey && record.stripNumber < (*found)->getNumberOfStrips()) {
+    target.pusher = *found;
+    target.strip = target.pusher->getStrip(record.stripNumber);
+  }
+  mTargets.insert(key, target);
+  return *mTargets.find(key);
+}
+
+bool FrameReplayer::playFrame(const RegistrySnapshot& snapshot) {
+  if(mNextFrame >= getFrameCount()) {
+    return false;
+  }
+  mTouched.clear();
+  for(size_t i = mFrames[mNextFrame]; i < mFrames[mNextFrame + 1]; i++) {
+    const FrameRecord* record = reinterpret_cast<const FrameRecord*>(mData + mRecords[i]);
+    const Target& target = resolve(snapshot, *record);
+    if(!target.strip || target.strip->getPixelFormat() != record->format) {
+      mUnmatchedRecords++;
+      continue;
+    }
+    PixelView view = target.strip->getPixelView();
+    const PixelFormatSpec& spec = getPixelFormatSpec(target.strip->getPixelFormat());
+    //a wire payload is the whole strip, including wire pixels a wide format leaves unused at the end
+    bool wire = record->source == FRAME_SOURCE_WIRE;
+    int bytesPerPixel = wire ? spec.wireBytes : spec.channels;
+    uint32_t length = wire ? (uint32_t)target.strip->getPixelDataLength() : (uint32_t)view.size();
+    if(record->channels != bytesPerPixel || record->length != length) {
+      mUnmatchedRecords++;
+      continue;
+    }
+    //app records are the channel buffer itself; wire records go back through the format
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(record + 1);
+    if(wire) {
+      spec.decode(data, view.data, view.length);
+    }
+    else {
+      memcpy(view.data, data, record->length);
+    }
+    target.strip->markTouched();
+    if(std::find(mTouched.begin(), mTouched.end(), target.pusher.get()) == mTouched.end()) {
+      mTouched.push_back(target.pusher.get());
+    }
+  }
+  for(size_t i = 0; i < mTouched.size(); i++) {
+    mTouched[i]->publish();
+  }
+  mNextFrame++;
+  return true;
+}
@@ -0,0 +1,66 @@
+/*
+ * FrameReplayer
+ *
+ * Plays a FrameRecorder log back into the registry.  The log is mapped read
+ * only and indexed once: records sharing a (MAC, frame id) are one pusher
+ * frame however the senders interleaved them, and a replay step takes pusher
+ * frames in log order until a pusher would repeat.  Playing a step is one
+ * copy per strip from the mapping into the strip's write buffer (a memcpy
+ * for app records, the format's decode() for wire records) followed by a
+ * publish() of every pusher it touched.  Call playFrame() in a loop to
+ * replay at full rate, or when getNextFrameMicros() has passed to keep the
+ * recorded timing.  Wire records carry the power scale already, so strips
+ * replaying them should be left at a scale of 1.0.  POSIX only; on Windows
+ * open() fails.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include "FrameRecorder.h"
+#include "FlatIndex.h"
+
+struct RegistrySnapshot;
+class PixelPusher;
+class Strip;
+
+class FrameReplayer {
+ public:
+  FrameReplayer();
+  ~FrameReplayer();
+  bool open(const std::string& path);
+  void close();
+  bool isOpen();
+  size_t getFrameCount();
+  size_t getRecordCount();
+  long long getDurationMicros();
+  // offset of the next frame from the first one, or -1 after the last
+  long long getNextFrameMicros();
+  // plays the next frame into the snapshot's strips; false once the log is done
+  bool playFrame(const RegistrySnapshot& snapshot);
+  void rewind();
+  // records whose pusher or strip is not registered, or whose format or size does not match the strip
+  unsigned long long getUnmatchedRecords();
+ private:
+  struct Target {
+    std::shared_ptr<PixelPusher> pusher;
+    std::shared_ptr<Strip> strip;
+  };
+  const Target& resolve(const RegistrySnapshot& snapshot, const FrameRecord& record);
+  void buildFrames(const std::vector<size_t>& offsets);
+  const unsigned char* mData;
+  size_t mSize;
+  // offsets of every complete record, grouped step by step
+  std::vector<size_t> mRecords;
+  // index into mRecords of each step's first record, then mRecords.size()
+  std::vector<size_t> mFrames;
+  size_t mNextFrame;
+  // (MAC << 16 | strip) -> target, valid for mGeneration
+  FlatIndex<Target> mTargets;
+  unsigned long mGeneration;
+  std::vector<PixelPusher*> mTouched;
+  unsigned long long mUnmatchedRecords;
+};
@@ -0,0 +1,56 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "LivenessTracker.h"
+#include <cstdlib>
+
+const double LivenessTracker::sMissedFactor = 1.5;
+
+LivenessTracker::LivenessTracker() {
+  mLastSeen = std::chrono::steady_clock::now();
+  mStats.lastSeenMicros = std::chrono::duration_cast<std::chrono::microseconds>(mLastSeen.time_since_epoch()).count();
+  mStats.meanIntervalMicros = 0;
+  mStats.jitterMicros = 0;
+  mStats.beaconCount = 0;
+  mStats.missedBeacons = 0;
+}
+
+void LivenessTracker::recordBeacon(TimePoint now) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  long long interval = std::chrono::duration_cast<std::chrono::microseconds>(now - mLastSeen).count();
+  mLastSeen = now;
+  mStats.lastSeenMicros = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+  mStats.beaconCount++;
+  if(mStats.beaconCount == 1) {
+    return;
+  }
+  if(mStats.beaconCount == 2 || mStats.meanIntervalMicros <= 0) {
+    mStats.meanIntervalMicros = interval;
+    return;
+  }
+
+  //a gap spanning several periods is that many beacons lost, not one slow one
+  long long mean = mStats.meanIntervalMicros;
+  long long periods = 1;
+  if(interval > mean * sMissedFactor) {
+    periods = (interval + mean / 2) / mean;
+    mStats.missedBeacons += (unsigned long)(periods - 1);
+  }
+  long long period = interval / periods;
+
+  //smoothed like RTP (RFC 3550): mean by 1/8, jitter by 1/16
+  mStats.meanIntervalMicros += (period - mean) / 8;
+  long long deviation = std::llabs(period - mean);
+  mStats.jitterMicros += (deviation - mStats.jitterMicros) / 16;
+}
+
+long long LivenessTracker::getSilenceMicros(TimePoint now) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return std::chrono::duration_cast<std::chrono::microseconds>(now - mLastSeen).count();
+}
+
+BeaconStats LivenessTracker::getStats() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mStats;
+}
@@ -0,0 +1,37 @@
+/*
+ * LivenessTracker
+ *
+ * Beacon arrival bookkeeping for one controller, on std::chrono::steady_clock
+ * so it is wall time and unaffected by how busy the process is.  Keeps the
+ * last arrival in microseconds, a smoothed inter-arrival mean and jitter, and
+ * an estimate of how many beacons went missing in between.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+struct BeaconStats {
+  // steady_clock time of the last beacon, in microseconds
+  long long lastSeenMicros;
+  long long meanIntervalMicros;
+  long long jitterMicros;
+  unsigned long beaconCount;
+  unsigned long missedBeacons;
+};
+
+class LivenessTracker {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+  LivenessTracker();
+  void recordBeacon(TimePoint now);
+  long long getSilenceMicros(TimePoint now);
+  BeaconStats getStats();
+ private:
+  // an interval this many means long counts the beacons in between as missed
+  static const double sMissedFactor;
+  std::mutex mMutex;
+  TimePoint mLastSeen;
+  BeaconStats mStats;
+};
@@ -0,0 +1,106 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "OfxUdpTransport.h"
+
+#ifndef PIXELPUSHER_HEADLESS
+
+#include "PixelPusherLog.h"
+#include "ofxUDPManager.h"
+#include <cerrno>
+
+OfxUdpTransport::OfxUdpTransport() {
+  mUdpConnection = NULL;
+  mLastError = 0;
+}
+
+OfxUdpTransport::~OfxUdpTransport() {
+  close();
+}
+
+void OfxUdpTransport::open(const TransportOptions& options) {
+  close();
+  mUdpConnection = new ofxUDPManager();
+  mUdpConnection->Create();
+  if(options.sendBufferBytes > 0) {
+    mUdpConnection->SetSendBufferSize(options.sendBufferBytes);
+  }
+  if(options.receiveBufferBytes > 0) {
+    mUdpConnection->SetReceiveBufferSize(options.receiveBufferBytes);
+  }
+  if(options.dscp >= 0) {
+    PP_LOG_WARNING("OfxUdpTransport can't mark packets; ignoring DSCP %d", options.dscp);
+  }
+}
+
+bool OfxUdpTransport::connect(const std::string& address, int port, const TransportOptions& options) {
+  open(options);
+  mUdpConnection->SetNonBlocking(options.nonBlocking);
+  if(!mUdpConnection->Connect(address.c_str(), port)) {
+    mLastError = ENOTCONN;
+    return false;
+  }
+  return true;
+}
+
+bool OfxUdpTransport::bind(int port, const TransportOptions& options) {
+  open(options);
+  mUdpConnection->SetReuseAddress(true);
+  if(!mUdpConnection->Bind(port)) {
+    mLastError = EADDRINUSE;
+    return false;
+  }
+  //no descriptor to poll, so receive() waits here instead
+  mUdpConnection->SetTimeoutReceive(1);
+  return true;
+}
+
+void OfxUdpTransport::close() {
+  if(mUdpConnection != NULL) {
+    mUdpConnection->Close();
+    delete mUdpConnection;
+    mUdpConnection = NULL;
+  }
+}
+
+int OfxUdpTransport::send(const iovec* iov, const size_t* starts, size_t packets) {
+  if(mUdpConnection == NULL) {
+    mLastError = EBADF;
+    return 0;
+  }
+  //no scatter-gather here, so flatten each packet into mPacket
+  for(size_t p = 0; p < packets; p++) {
+    mPacket.clear();
+    for(size_t i = starts[p]; i < starts[p+1]; i++) {
+      const unsigned char* segment = static_cast<const unsigned char*>(iov[i].iov_base);
+      mPacket.insert(mPacket.end(), segment, segment + iov[i].iov_len);
+    }
+    if(mUdpConnection->Send(reinterpret_cast<char *>(mPacket.data()), mPacket.size()) <= 0) {
+      mLastError = EIO;
+      return p;
+    }
+  }
+  return packets;
+}
+
+int OfxUdpTransport::receive(unsigned char* buffer, int length) {
+  if(mUdpConnection == NULL) {
+    return -1;
+  }
+  return mUdpConnection->Receive(reinterpret_cast<char *>(buffer), length);
+}
+
+int OfxUdpTransport::getDescriptor() {
+  return -1;
+}
+
+int OfxUdpTransport::getLastError() {
+  return mLastError;
+}
+
+const char* OfxUdpTransport::getName() {
+  return "ofxUDPManager";
+}
+
+#endif
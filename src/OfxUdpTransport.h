@@ -0,0 +1,34 @@
+/*
+ * OfxUdpTransport
+ *
+ * Transport on ofxUDPManager, the way the addon always sent.  ofxUDPManager
+ * has no scatter-gather, so each packet is flattened before it is sent, and
+ * it cannot be polled: receive() waits up to a second for a datagram.  DSCP
+ * marking is not supported.  Left out of PIXELPUSHER_HEADLESS builds.
+ */
+
+#pragma once
+
+#include "Transport.h"
+#include <vector>
+
+class ofxUDPManager;
+
+class OfxUdpTransport : public Transport {
+ public:
+  OfxUdpTransport();
+  ~OfxUdpTransport();
+  bool connect(const std::string& address, int port, const TransportOptions& options);
+  bool bind(int port, const TransportOptions& options);
+  void close();
+  int send(const iovec* iov, const size_t* starts, size_t packets);
+  int receive(unsigned char* buffer, int length);
+  int getDescriptor();
+  int getLastError();
+  const char* getName();
+ private:
+  void open(const TransportOptions& options);
+  ofxUDPManager* mUdpConnection;
+  std::vector<unsigned char> mPacket;
+  int mLastError;
+};
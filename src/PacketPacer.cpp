@@ -0,0 +1,85 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "PacketPacer.h"
+#include <algorithm>
+
+PacketPacer::PacketPacer() {
+  mIntervalMicros = 16667;
+  mBurst = 1;
+  mTokens = 1.0;
+  mStarted = false;
+  mWindowPackets = 0;
+  mAchievedPacketRate = 0.0;
+}
+
+void PacketPacer::configure(long updatePeriod, int packetsPerFrame, int frameLimit, long extraDelayMicros, int burst) {
+  //same rules the card thread used, kept in microseconds so nothing rounds down to zero
+  packetsPerFrame = std::max(packetsPerFrame, 1);
+  frameLimit = std::max(frameLimit, 1);
+  long interval;
+  if(updatePeriod > 100000) {
+    interval = 16667 / packetsPerFrame;
+  }
+  else if(updatePeriod > 1000) {
+    interval = updatePeriod + 1000;
+  }
+  else {
+    interval = (1000000 / frameLimit) / packetsPerFrame;
+  }
+  mIntervalMicros = std::max(interval + extraDelayMicros, 1L);
+  mBurst = std::max(burst, 1);
+  mTokens = std::min(mTokens, (double)mBurst);
+}
+
+void PacketPacer::refill(TimePoint now) {
+  if(!mStarted) {
+    mStarted = true;
+    mLastRefill = now;
+    mWindowStart = now;
+    mTokens = mBurst;
+    return;
+  }
+  long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - mLastRefill).count();
+  if(elapsed > 0) {
+    mTokens = std::min((double)mBurst, mTokens + (double)elapsed / mIntervalMicros);
+    mLastRefill = now;
+  }
+}
+
+int PacketPacer::getAvailable() {
+  return (int)mTokens;
+}
+
+void PacketPacer::consume(int packets, TimePoint now) {
+  mTokens -= packets;
+  mWindowPackets += packets;
+  long window = std::chrono::duration_cast<std::chrono::microseconds>(now - mWindowStart).count();
+  if(window >= sRateWindowMicros) {
+    mAchievedPacketRate = mWindowPackets * 1000000.0 / window;
+    mWindowPackets = 0;
+    mWindowStart = now;
+  }
+}
+
+PacketPacer::TimePoint PacketPacer::getNextDeadline(TimePoint now) {
+  //the absolute time at which the next whole token is available
+  if(mTokens >= 1.0) {
+    return now;
+  }
+  long wait = (long)((1.0 - mTokens) * mIntervalMicros) + 1;
+  return mLastRefill + std::chrono::microseconds(wait);
+}
+
+long PacketPacer::getIntervalMicros() {
+  return mIntervalMicros;
+}
+
+double PacketPacer::getTargetPacketRate() {
+  return 1000000.0 / mIntervalMicros;
+}
+
+double PacketPacer::getAchievedPacketRate() {
+  return mAchievedPacketRate;
+}
@@ -0,0 +1,37 @@
+/*
+ * PacketPacer
+ *
+ * Per-pusher token bucket on std::chrono::steady_clock.  Tokens refill at one
+ * per packet interval (derived from the controller's advertised update period)
+ * and are measured against absolute time points, so rounding never
+ * accumulates into frame rate drift.  It also keeps the achieved packet rate
+ * for comparison with the target.
+ */
+
+#pragma once
+
+#include <chrono>
+
+class PacketPacer {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+  PacketPacer();
+  void configure(long updatePeriod, int packetsPerFrame, int frameLimit, long extraDelayMicros, int burst);
+  void refill(TimePoint now);
+  int getAvailable();
+  void consume(int packets, TimePoint now);
+  TimePoint getNextDeadline(TimePoint now);
+  long getIntervalMicros();
+  double getTargetPacketRate();
+  double getAchievedPacketRate();
+ private:
+  static const long sRateWindowMicros = 1000000;
+  long mIntervalMicros;
+  int mBurst;
+  double mTokens;
+  TimePoint mLastRefill;
+  bool mStarted;
+  TimePoint mWindowStart;
+  long mWindowPackets;
+  double mAchievedPacketRate;
+};
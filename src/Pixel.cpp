@@ -90,3 +90,7 @@ void Pixel::setColor(Pixel pixel) {
 void Pixel::setAntiLog(bool useAntiLog) {
   mUseAntiLog = useAntiLog;
 }
+
+const unsigned char* Pixel::getAntiLogTable() {
+  return mLinearExp;
+}
@@ -21,6 +21,7 @@ class Pixel {
   void setColor(unsigned char r, unsigned char g, unsigned char b, unsigned char o, unsigned char w);
   void setColor (Pixel pixel);
   void setAntiLog(bool useAntiLog);
+  static const unsigned char* getAntiLogTable();
  protected:
   bool mUseAntiLog;
   unsigned char mRed;
@@ -0,0 +1,29 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "PixelFormat.h"
+
+template <PixelFormat Format>
+static PixelFormatSpec makeSpec(const char* name) {
+  PixelFormatSpec spec;
+  spec.format = Format;
+  spec.channels = PixelFormatTraits<Format>::sChannels;
+  spec.wireBytes = PixelFormatTraits<Format>::sWireBytes;
+  spec.encode = &PixelFormatTraits<Format>::encode;
+  spec.decode = &PixelFormatTraits<Format>::decode;
+  spec.name = name;
+  return spec;
+}
+
+static const PixelFormatSpec sSpecs[PIXEL_FORMATS] = {
+  makeSpec<PIXEL_RGB>("RGB"),
+  makeSpec<PIXEL_GRB>("GRB"),
+  makeSpec<PIXEL_RGBW>("RGBW"),
+  makeSpec<PIXEL_RGBOW>("RGBOW"),
+  makeSpec<PIXEL_RGB16>("RGB16")
+};
+
+const PixelFormatSpec& getPixelFormatSpec(PixelFormat format) {
+  return sSpecs[format < PIXEL_FORMATS ? format : PIXEL_RGB];
+}
@@ -0,0 +1,126 @@
+/*
+ * PixelFormat
+ *
+ * How a strip's pixels are laid out in its channel buffer and on the wire.
+ * Each format is a PixelFormatTraits specialization whose encode() is a
+ * straight loop for that layout alone; decode() undoes an unscaled encode()
+ * so a replayed wire log lands back in the channel buffer.  getPixelFormatSpec() hands out the
+ * instantiations; a Strip takes its spec when its format is set, so
+ * Strip::serialize() never branches on the format.
+ *
+ *   RGB    R,G,B                          3 wire bytes per pixel
+ *   GRB    R,G,B, sent G,R,B              3
+ *   RGBW   R,G,B,W                        4, packed across wire pixels
+ *   RGBOW  R,G,B,O,W, sent R,G,B,O,O,O,W,W,W  9
+ *   RGB16  R,G,B high bytes, then low     6, two wire pixels
+ *
+ * Every buffer starts with 8-bit R,G,B, so code writing three bytes per
+ * pixel through a PixelView works for all of them (on RGB16 it sets the
+ * high bytes).
+ */
+
+#pragma once
+
+#include <cstring>
+#include "Serializer.h"
+
+enum PixelFormat {
+  PIXEL_RGB,
+  PIXEL_GRB,
+  PIXEL_RGBW,
+  PIXEL_RGBOW,
+  PIXEL_RGB16,
+  PIXEL_FORMATS
+};
+
+struct PixelFormatSpec {
+  typedef void (*EncodeKernel)(const unsigned char* pixels, unsigned char* wire, int count, unsigned int scale);
+  typedef void (*DecodeKernel)(const unsigned char* wire, unsigned char* pixels, int count);
+  PixelFormat format;
+  // bytes per pixel in the channel buffer, and on the wire
+  int channels;
+  int wireBytes;
+  EncodeKernel encode;
+  DecodeKernel decode;
+  const char* name;
+};
+
+const PixelFormatSpec& getPixelFormatSpec(PixelFormat format);
+
+template <PixelFormat Format>
+struct PixelFormatTraits;
+
+template <>
+struct PixelFormatTraits<PIXEL_RGB> {
+  static const int sChannels = 3;
+  static const int sWireBytes = 3;
+  static void encode(const unsigned char* pixels, unsigned char* wire, int count, unsigned int scale) {
+    //the buffer already is the wire layout, so this is one kernel call
+    Serializer::scale(pixels, wire, 3 * count, scale);
+  }
+  static void decode(const unsigned char* wire, unsigned char* pixels, int count) {
+    memcpy(pixels, wire, 3 * count);
+  }
+};
+
+template <>
+struct PixelFormatTraits<PIXEL_GRB> {
+  static const int sChannels = 3;
+  static const int sWireBytes = 3;
+  static void encode(const unsigned char* pixels, unsigned char* wire, int count, unsigned int scale) {
+    for(int i = 0; i < count; i++, pixels += 3, wire += 3) {
+      wire[0] = (unsigned char)Serializer::applyScale(pixels[1], scale);
+      wire[1] = (unsigned char)Serializer::applyScale(pixels[0], scale);
+      wire[2] = (unsigned char)Serializer::applyScale(pixels[2], scale);
+    }
+  }
+  static void decode(const unsigned char* wire, unsigned char* pixels, int count) {
+    for(int i = 0; i < count; i++, pixels += 3, wire += 3) {
+      pixels[0] = wire[1];
+      pixels[1] = wire[0];
+      pixels[2] = wire[2];
+    }
+  }
+};
+
+template <>
+struct PixelFormatTraits<PIXEL_RGBW> {
+  static const int sChannels = 4;
+  static const int sWireBytes = 4;
+  static void encode(const unsigned char* pixels, unsigned char* wire, int count, unsigned int scale) {
+    Serializer::scale(pixels, wire, 4 * count, scale);
+  }
+  static void decode(const unsigned char* wire, unsigned char* pixels, int count) {
+    memcpy(pixels, wire, 4 * count);
+  }
+};
+
+template <>
+struct PixelFormatTraits<PIXEL_RGBOW> {
+  static const int sChannels = 5;
+  static const int sWireBytes = 9;
+  static void encode(const unsigned char* pixels, unsigned char* wire, int count, unsigned int scale) {
+    Serializer::expandRGBOW(pixels, wire, count, scale);
+  }
+  static void decode(const unsigned char* wire, unsigned char* pixels, int count) {
+    for(int i = 0; i < count; i++, pixels += 5, wire += 9) {
+      pixels[0] = wire[0];
+      pixels[1] = wire[1];
+      pixels[2] = wire[2];
+      pixels[3] = wire[3];
+      pixels[4] = wire[6];
+    }
+  }
+};
+
+template <>
+struct PixelFormatTraits<PIXEL_RGB16> {
+  static const int sChannels = 6;
+  static const int sWireBytes = 6;
+  static void encode(const unsigned char* pixels, unsigned char* wire, int count, unsigned int scale) {
+    Serializer::scaleRGB16(pixels, wire, count, scale);
+  }
+  static void decode(const unsigned char* wire, unsigned char* pixels, int count) {
+    memcpy(pixels, wire, 6 * count);
+  }
+};
@@ -0,0 +1,159 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "PixelMap.h"
+#include "DiscoveryListener.h"
+#include <algorithm>
+
+PixelMap::PixelMap(int width, int height, int stride) {
+  mWidth = width;
+  mHeight = height;
+  mStride = stride;
+  mGeneration = 0;
+  mCompiled = false;
+}
+
+void PixelMap::addRun(const PixelMapRun& run) {
+  mRuns.push_back(run);
+  mCompiled = false;
+}
+
+void PixelMap::clear() {
+  mRuns.clear();
+  mTargets.clear();
+  mTable.clear();
+  mCompiled = false;
+}
+
+void PixelMap::compile(DiscoveryListener* listener) {
+  std::shared_ptr<const RegistrySnapshot> snapshot = listener->getSnapshot();
+  mGeneration = snapshot->generation;
+  resolve(*snapshot, true);
+  mCompiled = true;
+}
+
+bool PixelMap::update(DiscoveryListener* listener) {
+  if(!mCompiled) {
+    compile(listener);
+    return true;
+  }
+  if(listener->getGeneration() == mGeneration) {
+    return false;
+  }
+  //resolve every run against the same snapshot
+  std::shared_ptr<const RegistrySnapshot> snapshot = listener->getSnapshot();
+  mGeneration = snapshot->generation;
+  resolve(*snapshot, false);
+  return true;
+}
+
+void PixelMap::resolve(const RegistrySnapshot& snapshot, bool force) {
+  //runs whose pusher is unchanged keep their old slice; only the others are rebuilt
+  std::vector<Target> targets(mRuns.size());
+  std::vector<Gather> table;
+  table.reserve(mTable.size());
+  for(size_t i = 0; i < mRuns.size(); i++) {
+    const PixelMapRun& run = mRuns[i];
+    std::shared_ptr<PixelPusher> pusher = snapshot.getController(run.groupId, run.controllerId);
+    Target& target = targets[i];
+    target.pusher = pusher;
+    target.begin = table.size();
+    if(!force && i < mTargets.size() && mTargets[i].pusher == pusher) {
+      target.strip = mTargets[i].strip;
+      target.firstPixel = mTargets[i].firstPixel;
+      target.lastPixel = mTargets[i].lastPixel;
+      target.direct = mTargets[i].direct;
+      table.insert(table.end(), mTable.begin() + mTargets[i].begin, mTable.begin() + mTargets[i].end);
+    }
+    else {
+      buildRun(run, target, table);
+    }
+    target.end = table.size();
+  }
+  mTargets.swap(targets);
+  mTable.swap(table);
+}
+
+void PixelMap::buildRun(const PixelMapRun& run, Target& target, std::vector<Gather>& table) {
+  target.strip.reset();
+  target.firstPixel = 0;
+  target.lastPixel = -1;
+  target.direct = true;
+  if(!target.pusher || run.stripNumber < 0 || run.stripNumber >= target.pusher->getNumberOfStrips()) {
+    return;
+  }
+  target.strip = target.pusher->getStrip(run.stripNumber);
+  int length = target.strip->getLength();
+  int channels = target.strip->getChannels();
+  //16-bit strips also need the low bytes and RGBOW strips orange and white
+  PixelFormat format = target.strip->getPixelFormat();
+  target.direct = format != PIXEL_RGB16 && format != PIXEL_RGBOW;
+  for(int i = 0; i < run.count; i++) {
+    int x = run.x + i * run.dx;
+    int y = run.y + i * run.dy;
+    int position = run.startPixel + i;
+    if(x < 0 || x >= mWidth || y < 0 || y >= mHeight || position < 0 || position >= length) {
+      continue;
+    }
+    Gather gather;
+    gather.source = y * mStride + x * 3;
+    gather.destination = position * channels;
+    table.push_back(gather);
+    if(target.lastPixel < target.firstPixel) {
+      target.firstPixel = position;
+      target.lastPixel = position;
+    }
+    target.firstPixel = std::min(target.firstPixel, position);
+    target.lastPixel = std::max(target.lastPixel, position);
+  }
+}
+
+void PixelMap::apply(const unsigned char* canvas) {
+  const unsigned char* antiLog = Pixel::getAntiLogTable();
+  for(size_t i = 0; i < mTargets.size(); i++) {
+    Target& target = mTargets[i];
+    if(!target.strip || target.begin == target.end) {
+      continue;
+    }
+    unsigned char* pixels = target.strip->getPixelView().data;
+    const Gather* gather = &mTable[target.begin];
+    const Gather* end = &mTable[0] + target.end;
+    bool useAntiLog = target.strip->getAntiLog();
+    if(!target.direct) {
+      for(; gather != end; ++gather) {
+        const unsigned char* source = canvas + gather->source;
+        unsigned char rgb[3] = { source[0], source[1], source[2] };
+        if(useAntiLog) {
+          rgb[0] = antiLog[rgb[0]];
+          rgb[1] = antiLog[rgb[1]];
+          rgb[2] = antiLog[rgb[2]];
+        }
+        target.strip->storeRGBPixel(pixels + gather->destination, rgb);
+      }
+    }
+    else if(useAntiLog) {
+      for(; gather != end; ++gather) {
+        const unsigned char* source = canvas + gather->source;
+        unsigned char* destination = pixels + gather->destination;
+        destination[0] = antiLog[source[0]];
+        destination[1] = antiLog[source[1]];
+        destination[2] = antiLog[source[2]];
+      }
+    }
+    else {
+      for(; gather != end; ++gather) {
+        const unsigned char* source = canvas + gather->source;
+        unsigned char* destination = pixels + gather->destination;
+        destination[0] = source[0];
+        destination[1] = source[1];
+        destination[2] = source[2];
+      }
+    }
+    target.strip->markTouched(target.firstPixel, target.lastPixel - target.firstPixel + 1);
+  }
+}
+
+int PixelMap::getMappedPixels() {
+  return mTable.size();
+}
@@ -0,0 +1,67 @@
+/*
+ * PixelMap
+ *
+ * Routes a 2D RGB canvas onto every strip in the registry.  The layout is a
+ * list of runs, each one walking the canvas from (x, y) in steps of (dx, dy)
+ * and landing on consecutive LEDs of one strip.  compile() resolves the runs
+ * against the DiscoveryListener into a flat gather table once; apply() then
+ * fills all strips from the canvas without any per-LED lookups.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "PixelPusher.h"
+
+class DiscoveryListener;
+struct RegistrySnapshot;
+
+struct PixelMapRun {
+  long groupId;
+  long controllerId;
+  int stripNumber;
+  int startPixel;
+  int count;
+  int x;
+  int y;
+  int dx;
+  int dy;
+};
+
+class PixelMap {
+ public:
+  PixelMap(int width, int height, int stride);
+  void addRun(const PixelMapRun& run);
+  void clear();
+  void compile(DiscoveryListener* listener);
+  bool update(DiscoveryListener* listener);
+  void apply(const unsigned char* canvas);
+  int getMappedPixels();
+ private:
+  struct Gather {
+    int source;
+    int destination;
+  };
+  struct Target {
+    std::shared_ptr<PixelPusher> pusher;
+    std::shared_ptr<Strip> strip;
+    size_t begin;
+    size_t end;
+    int firstPixel;
+    int lastPixel;
+    // the strip keeps RGB as three plain bytes, so apply() can copy them
+    bool direct;
+  };
+  void resolve(const RegistrySnapshot& snapshot, bool force);
+  void buildRun(const PixelMapRun& run, Target& target, std::vector<Gather>& table);
+  int mWidth;
+  int mHeight;
+  int mStride;
+  std::vector<PixelMapRun> mRuns;
+  // parallel to mRuns; each target owns the slice [begin, end) of mTable
+  std::vector<Target> mTargets;
+  std::vector<Gather> mTable;
+  unsigned long mGeneration;
+  bool mCompiled;
+};
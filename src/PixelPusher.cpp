@@ -2,75 +2,93 @@
 #include "stdafx.h"
 #endif
 
-#include "ofLog.h"
+#include "PixelPusherLog.h"
 #include "PixelPusher.h"
+#include "SenderEngine.h"
 #include <algorithm>
-#include <ctime>
+#include <cstring>
 
 PixelPusher::PixelPusher(DeviceHeader* header) {
   mArtnetUniverse = 0;
   mArtnetChannel = 0;
   mPort = 9897;
   mStripsAttached = 0;
+  mMaxStripsPerPacket = 0;
+  mFrameStripsPerPacket = 1;
   mPixelsPerStrip = 0;
-  mExtraDelayMsec = 0;
+  mThrottle = ThrottleController::create(THROTTLE_AIMD);
+  mPacketsSent = 0;
+  mPacketsAtLastBeacon = 0;
   mMulticast = false;
   mMulticastPrimary = false;
   mAutothrottle = false;
   mSegments = 0;
   mPowerDomain = 0;
-  mLastPingAt = std::clock() / CLOCKS_PER_SEC;
-  mResetSentAt = std::clock() / CLOCKS_PER_SEC;
+  mTimeoutMillis = sDefaultTimeoutMillis;
+  mResetSentAt = std::chrono::steady_clock::now();
   mSendReset = false;
-
-  mDeviceHeader = header;
-  std::shared_ptr<unsigned char> packetRemainder = header->getPacketRemainder();
-  int packetLength = header->getPacketRemainderLength();
-
-  if(packetLength < 28) {
-    ofLogError() << "Packet size is too small! PixelPusher can't be created.";
-  }
-
-  memcpy(&mStripsAttached, &packetRemainder.get()[0], 1);
-  memcpy(&mMaxStripsPerPacket, &packetRemainder.get()[1], 1);
-  memcpy(&mPixelsPerStrip, &packetRemainder.get()[2], 2);
-  memcpy(&mUpdatePeriod, &packetRemainder.get()[4], 4);
-  memcpy(&mPowerTotal, &packetRemainder.get()[8], 4);
-  memcpy(&mDeltaSequence, &packetRemainder.get()[12], 4);
-  memcpy(&mControllerId, &packetRemainder.get()[16], 4);
-  memcpy(&mGroupId, &packetRemainder.get()[20], 4);
-  memcpy(&mArtnetUniverse, &packetRemainder.get()[24], 2);
-  memcpy(&mArtnetChannel, &packetRemainder.get()[26], 2);
-
-  if(packetLength < 28 && header->getSoftwareRevision() > 100) {
-    memcpy(&mPort, &packetRemainder.get()[28], 2);
+  mSenderEngine = NULL;
+  mPacketLimit = 1;
+  for(int i = 0; i < 3; i++) {
+    mSlotTags[i].frame = 0;
+    mSlotTags[i].deadlineMicros = 0;
   }
-  else {
-    mPort = 9897; 
-  }
-  short defaultNumberOfStrips = 8;
-  short stripFlagSize = std::max(mStripsAttached, defaultNumberOfStrips);
-  mStripFlags.resize(stripFlagSize);
-  
-  if (packetLength > 30 && header->getSoftwareRevision() > 108) {
-    memcpy(&mStripFlags[0], &packetRemainder.get()[30], stripFlagSize);
-  }
-  else {
-    for (int i = 0; i < stripFlagSize; i++) {
-      mStripFlags[i] = 0;
-    }
+  mFrameInFlight = 0;
+  mFrameDeadline = 0;
+  mFrameLatched = true;
+  mFrameAcquired = false;
+  mLatchedFrame = 0;
+  mLatchedAt = 0;
+  mFrameEncodedBytes = 0;
+  mFrameBeganMicros = 0;
+  mFrameSequence = 0;
+  mTripleBuffer = std::make_shared<TripleBuffer>();
+  mEncodedBytes = 0;
+  mBatchedSend = false;
+  mSendFailing = false;
+  mPixelFormat = PIXEL_RGB;
+
+  mDeviceHeader = std::shared_ptr<DeviceHeader>(header);
+  BeaconView beacon = BeaconView();
+  if(!header->getBeacon(beacon)) {
+    PP_LOG_ERROR("Packet size is too small! PixelPusher can't be created.");
+    //keep who it is, but give it no strips rather than whatever the short packet held
+    BeaconView empty = BeaconView();
+    memcpy(empty.macAddress, beacon.macAddress, 6);
+    memcpy(empty.ipAddress, beacon.ipAddress, 4);
+    beacon = empty;
   }
+  applyBeacon(beacon);
+}
 
-  if (packetLength > 30 + stripFlagSize && header->getSoftwareRevision() > 108 ) {
-    // set Pusher flags
-    long pusherFlags;
-    memcpy(&pusherFlags, &packetRemainder.get()[32+stripFlagSize], 4);
-    setPusherFlags(pusherFlags);
-    memcpy(&mSegments, &packetRemainder.get()[36+stripFlagSize], 4);
-    memcpy(&mPowerDomain, &packetRemainder.get()[40+stripFlagSize], 4);
-  }
+void PixelPusher::applyBeacon(const BeaconView& beacon) {
+  mStripsAttached = beacon.stripsAttached;
+  mPixelsPerStrip = beacon.pixelsPerStrip;
+  mControllerId = beacon.controllerId;
+  mGroupId = beacon.groupId;
+  mArtnetUniverse = beacon.artnetUniverse;
+  mArtnetChannel = beacon.artnetChannel;
+  mPort = beacon.port;
+  mStripFlags.assign(beacon.stripFlags, beacon.stripFlags + beacon.stripFlagCount);
+  setPusherFlags(beacon.pusherFlags);
+  mSegments = beacon.segments;
+  mPowerDomain = beacon.powerDomain;
+  mMacKey = beacon.getMacKey();
+  mFingerprint = beacon.getFingerprint();
+  updateCounters(beacon);
+}
 
-  mPacket.reserve(400*mMaxStripsPerPacket); //too high, can be reduced
+void PixelPusher::updateCounters(const BeaconView& beacon) {
+  //the per-beacon fast path: nothing here allocates
+  mDeltaSequence = beacon.deltaSequence;
+  mUpdatePeriod = beacon.updatePeriod;
+  mPowerTotal = beacon.powerTotal;
+  mMaxStripsPerPacket = std::max<short>(beacon.maxStripsPerPacket, 1);
+  mLiveness.recordBeacon(std::chrono::steady_clock::now());
+}
+
+PixelPusher::~PixelPusher() {
+  destroyCardThread();
 }
 
 int PixelPusher::getNumberOfStrips() {
@@ -92,9 +110,68 @@ std::deque<std::shared_ptr<Strip> > PixelPusher::getTouchedStrips() {
 }
 
 void PixelPusher::addStrip(std::shared_ptr<Strip> strip) {
+  strip->setTripleBuffer(mTripleBuffer);
   mStrips.push_back(strip);
 }
 
+void PixelPusher::publish() {
+  publish(0, 0);
+}
+
+void PixelPusher::publish(unsigned long frame, long long deadlineMicros) {
+  int pending = mTripleBuffer->getPendingIndex();
+  mMetrics.recordSubmitted(pending >= 0);
+  if(pending >= 0) {
+    for(auto strip : mStrips) {
+      strip->carryOver(pending);
+    }
+  }
+  //the tag travels with the slot, so a later untagged publish() cannot relabel it
+  FrameTag& tag = mSlotTags[mTripleBuffer->getWriteIndex()];
+  tag.frame = frame;
+  tag.deadlineMicros = deadlineMicros;
+  unsigned long dropped = mTripleBuffer->getDroppedFrames();
+  int published = mTripleBuffer->publish();
+  for(auto strip : mStrips) {
+    strip->commit(published);
+  }
+  //a group frame replaced before the sender picked it up never goes out
+  if(mTripleBuffer->getDroppedFrames() != dropped && mSlotTags[mTripleBuffer->getWriteIndex()].frame != 0) {
+    PP_TRACE(TRACE_FRAME_MISSED, mMacKey, mSlotTags[mTripleBuffer->getWriteIndex()].frame, 0);
+    mMetrics.recordFrameMissed();
+  }
+}
+
+void PixelPusher::submitFrame(unsigned long frame, long long deadlineMicros) {
+  publish(frame, deadlineMicros);
+}
+
+unsigned long PixelPusher::getLatchedFrame() {
+  return mLatchedFrame.load();
+}
+
+long long PixelPusher::getLatchedAtMicros() {
+  return mLatchedAt.load();
+}
+
+void PixelPusher::latchFrame(std::chrono::steady_clock::time_point now) {
+  //called once the last strip of the frame is on the wire
+  long long latchedAt = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+  mFrameLatched = true;
+  mLatchedAt.store(latchedAt);
+  mLatchedFrame.store(mFrameInFlight);
+  if(mFrameDeadline != 0 && latchedAt > mFrameDeadline) {
+    PP_TRACE(TRACE_FRAME_MISSED, mMacKey, mFrameInFlight, latchedAt - mFrameDeadline);
+    mMetrics.recordFrameMissed();
+  }
+}
+
+bool PixelPusher::isFrameOverdue(std::chrono::steady_clock::time_point now) {
+  //a group frame whose window is closing goes out regardless of the pacer
+  return !mFrameLatched && mFrameDeadline != 0 &&
+    std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() >= mFrameDeadline;
+}
+
 std::shared_ptr<Strip> PixelPusher::getStrip(int stripNumber) {
   return mStrips.at(stripNumber);
 }
@@ -116,38 +193,41 @@ void PixelPusher::setStripValues(int stripNumber, std::vector<std::shared_ptr<Pi
 }
 
 std::string PixelPusher::getMacAddress() {
-  return mDeviceHeader->getMacAddressString();
+  return std::atomic_load(&mDeviceHeader)->getMacAddressString();
 }
 
 std::string PixelPusher::getIpAddress() {
-  return mDeviceHeader->getIpAddressString();
+  return std::atomic_load(&mDeviceHeader)->getIpAddressString();
 }
 
-void PixelPusher::sendPacket() {
-  std::deque<std::shared_ptr<Strip> > remainingStrips = getTouchedStrips();
-  bool payload = false;
-  long packetLength = 0;
-  mThreadDelay = 16.0;
-  mPacket.clear();
-  mRunCardThread = true;
-
-  while(mRunCardThread) {
-  if(getUpdatePeriod() > 100000.0) {
-    mThreadDelay = (16.0 / (mStripsAttached / mMaxStripsPerPacket));
-  }
-  else if(getUpdatePeriod() > 1000.0) {
-    mThreadDelay = (getUpdatePeriod() / 1000.0) + 1;
-  }
-  else {
-    mThreadDelay = ((1000.0 / mFrameLimit) / (mStripsAttached / mMaxStripsPerPacket));
+void PixelPusher::beginFrame() {
+  if(mTripleBuffer->acquire()) {
+    for(auto strip : mStrips) {
+      strip->acquire();
+    }
+    const FrameTag& tag = mSlotTags[mTripleBuffer->getReadIndex()];
+    mFrameInFlight = tag.frame;
+    mFrameDeadline = tag.deadlineMicros;
+    mFrameLatched = false;
+    mFrameAcquired = true;
   }
+  mRemainingStrips = getTouchedStrips();
+  mFrameEncodedBytes = 0;
+  mFrameBeganMicros = FrameRecorder::getTimeMicros();
+  mFrameSequence++;
+  mFrameStripsPerPacket = mMaxStripsPerPacket.load();
+  int packetsPerFrame = (std::max<int>(mStripsAttached, 1) + mFrameStripsPerPacket - 1) / mFrameStripsPerPacket;
+  //a frame with a window goes out in one burst so it has the best chance of making it
+  bool burst = (mBatchedSend && !needsPacing()) || (!mFrameLatched && mFrameDeadline != 0);
+  long extraDelayMicros = getExtraDelayMicros();
+  mPacer.configure(mUpdatePeriod, packetsPerFrame, mFrameLimit, mThreadExtraDelay * 1000 + extraDelayMicros, burst ? packetsPerFrame : 1);
+  mThreadDelay = (mPacer.getIntervalMicros() - extraDelayMicros) / 1000 - mThreadExtraDelay;
+  mTotalDelay = mPacer.getIntervalMicros() / 1000;
+  mMetrics.setTotalDelayMicros(mPacer.getIntervalMicros());
   
-  mTotalDelay = mThreadDelay + mThreadExtraDelay + mExtraDelayMsec;
-  
-  ofLogNotice("", "Total delay for PixelPusher %s is %ld", getMacAddress().c_str(), mTotalDelay);
-
-  if(!mSendReset && remainingStrips.empty()) {
-		this_thread::sleep_for(std::chrono::milliseconds(mTotalDelay));
+  PP_LOG_VERBOSE("Total delay for PixelPusher %s is %ld", getMacAddress().c_str(), mTotalDelay);
+  if(!mRemainingStrips.empty()) {
+    PP_TRACE(TRACE_FRAME_BEGIN, mMacKey, mRemainingStrips.size(), mPacer.getIntervalMicros());
   }
 
   /*
@@ -165,60 +245,189 @@ void PixelPusher::sendPacket() {
   }
   */
 
-  while(!remainingStrips.empty()) {
-    ofLogNotice("", "Sending data to PixelPusher %s at %s:%d", getMacAddress().c_str(), getIpAddress().c_str(), mPort);
-    payload = false;
-    //packetLength = 0;
-    //memcpy(&mPacket[0], &mPacketNumber, 4);
-    //packetLength += 4;
-    mPacket.clear();
-    mPacket.push_back((mPacketNumber >> 24) & 0xFF);
-    mPacket.push_back((mPacketNumber >> 16) & 0xFF);
-    mPacket.push_back((mPacketNumber >> 8) & 0xFF);
-    mPacket.push_back(mPacketNumber & 0xFF);
-    
-    for(int i = 0; i < mMaxStripsPerPacket; i++) {
-      ofLogNotice("", "Packing strip %d of %hu...", i, mMaxStripsPerPacket);
-
-      if(remainingStrips.empty()) {
-				this_thread::sleep_for(std::chrono::milliseconds(mTotalDelay));
-				continue;
-      }
-      
-      std::shared_ptr<Strip> strip = remainingStrips.front();
-      strip->serialize();
-      unsigned char* stripData = strip->getPixelData();
-      int stripDataLength = strip->getPixelDataLength();
-      short stripNumber = strip->getStripNumber();
-      //memcpy(&mPacket[packetLength], &stripNumber, 2);
-      //packetLength += 2;
-      mPacket.push_back((stripNumber >> 8) & 0xFF);
-      mPacket.push_back(stripNumber & 0xFF);
-	
-      //memcpy(&mPacket[packetLength], &stripData, stripDataLength);
-      //packetLength += stripDataLength;
-      
-      /**************************************************************
-               This seems to be where all of my problems are :(
-       *************************************************************/
-      std::copy(strip->begin(), strip->end(), back_inserter(mPacket));
-      //copy doesn't seem to add stuff to mPacket...
-      payload = true;
-      remainingStrips.pop_front();
+  //headers for every packet of this frame, sized up front so the iovecs stay valid
+  size_t framePackets = (mRemainingStrips.size() + mFrameStripsPerPacket - 1) / mFrameStripsPerPacket;
+  if(mPacketHeaders.size() < 4 * framePackets) {
+    mPacketHeaders.resize(4 * framePackets);
+  }
+  mPacketLimit = burst ? framePackets : 1;
+}
+
+std::chrono::steady_clock::time_point PixelPusher::service(std::chrono::steady_clock::time_point now) {
+  //called by a SenderEngine worker once the previous deadline has passed;
+  //sends as much of the current frame as the pacer allows and says when to come back
+  mPacer.refill(now);
+  if(mRemainingStrips.empty()) {
+    beginFrame();
+  }
+  if(mRemainingStrips.empty()) {
+    if(!mFrameLatched) {
+      //nothing changed, so this controller already shows the frame
+      latchFrame(now);
     }
-    
-    if(payload) {
-      ofLogNotice("", "Payload confirmed; sending packet of %lu bytes", mPacket.size());
-      mPacketNumber++;
-			mUdpConnection->Send(reinterpret_cast<char *>(mPacket.data()), mPacket.size());
-      //mUdpConnection.Send(reinterpret_cast<char *>(mPacket.data()), mPacket.size());
-      payload = false;
-      this_thread::sleep_for(std::chrono::milliseconds(mTotalDelay));
+    if(mFrameAcquired) {
+      mFrameAcquired = false;
+      mMetrics.recordFrameSent();
+    }
+    return now + std::chrono::microseconds(mPacer.getIntervalMicros());
+  }
+  size_t budget = mPacer.getAvailable();
+  bool overdue = isFrameOverdue(now);
+  if(budget == 0 && !overdue) {
+    return getNextDeadline(now);
+  }
+
+  PP_LOG_VERBOSE("Sending data to PixelPusher %s at %s:%d", getMacAddress().c_str(), getIpAddress().c_str(), mPort);
+  mPacketIov.clear();
+  mPacketStarts.clear();
+  //an overdue frame borrows from the pacer; the debt slows the frames after it
+  size_t packetLimit = overdue ? mPacketLimit : std::min(mPacketLimit, budget);
+  std::chrono::steady_clock::time_point serializeStart = std::chrono::steady_clock::now();
+  while(mPacketStarts.size() < packetLimit && !mRemainingStrips.empty()) {
+    mFrameEncodedBytes += packPacket(mRemainingStrips);
+  }
+  mMetrics.recordSerialize(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - serializeStart).count());
+  
+  int packets = mPacketStarts.size();
+  long long bytes = 0;
+  for(size_t i = 0; i < mPacketIov.size(); i++) {
+    bytes += mPacketIov[i].iov_len;
+  }
+  PP_LOG_VERBOSE("Payload confirmed; sending %d packets", packets);
+  std::chrono::steady_clock::time_point sendStart = std::chrono::steady_clock::now();
+  bool sent = writePackets();
+  long long sendMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sendStart).count();
+  if(sent) {
+    PP_TRACE(TRACE_PACKETS_SENT, mMacKey, packets, bytes);
+    if(mSendFailing) {
+      mSendFailing = false;
+      PP_LOG_NOTICE("Sending to PixelPusher %s works again", getMacAddress().c_str());
+    }
+  }
+  else {
+    //every failure is traced and counted; only the first of a run is logged
+    PP_TRACE(TRACE_SEND_FAILED, mMacKey, packets, mTransport->getLastError());
+    if(!mSendFailing) {
+      mSendFailing = true;
+      PP_LOG_ERROR("Failed to send packet to PixelPusher %s: error %d", getMacAddress().c_str(), mTransport->getLastError());
+    }
+  }
+  mMetrics.recordSend(packets, bytes, sendMicros, !sent, now);
+  std::shared_ptr<FrameRecorder> recorder = std::atomic_load(&mFrameRecorder);
+  if(recorder) {
+    recordPackets(*recorder);
+  }
+  mPacer.consume(packets, now);
+  mPacketsSent += packets;
+  if(mRemainingStrips.empty() && !mFrameLatched) {
+    latchFrame(now);
+  }
+  if(mRemainingStrips.empty() && mFrameEncodedBytes > 0) {
+    mEncodedBytes = mFrameEncodedBytes;
+  }
+  if(mRemainingStrips.empty() && mFrameAcquired) {
+    mFrameAcquired = false;
+    mMetrics.recordFrameSent();
+  }
+  return getNextDeadline(now);
+}
+
+std::chrono::steady_clock::time_point PixelPusher::getNextDeadline(std::chrono::steady_clock::time_point now) {
+  //when the pacer wants to send next, or sooner if a group frame's window closes first
+  std::chrono::steady_clock::time_point next = mPacer.getNextDeadline(now);
+  if(!mFrameLatched && mFrameDeadline != 0) {
+    next = std::min(next, std::chrono::steady_clock::time_point(std::chrono::microseconds(mFrameDeadline)));
+  }
+  return next;
+}
+
+double PixelPusher::getTargetPacketRate() {
+  return mPacer.getTargetPacketRate();
+}
+
+double PixelPusher::getAchievedPacketRate() {
+  return mPacer.getAchievedPacketRate();
+}
+
+long PixelPusher::packPacket(std::deque<std::shared_ptr<Strip> >& remainingStrips) {
+  long encodedBytes = 0;
+  unsigned char* header = &mPacketHeaders[4 * mPacketStarts.size()];
+  header[0] = (mPacketNumber >> 24) & 0xFF;
+  header[1] = (mPacketNumber >> 16) & 0xFF;
+  header[2] = (mPacketNumber >> 8) & 0xFF;
+  header[3] = mPacketNumber & 0xFF;
+  mPacketNumber++;
+  mPacketStarts.push_back(mPacketIov.size());
+  iovec headerSegment = { header, 4 };
+  mPacketIov.push_back(headerSegment);
+
+  for(int i = 0; i < mFrameStripsPerPacket && !remainingStrips.empty(); i++) {
+    PP_LOG_VERBOSE("Packing strip %d of %d...", i, mFrameStripsPerPacket);
+
+    //the packet only references the strip buffers; mStrips keeps them alive
+    std::shared_ptr<Strip> strip = remainingStrips.front();
+    strip->serialize();
+    encodedBytes += strip->getEncodedBytes();
+    iovec stripNumber = { strip->getStripNumberData(), 2 };
+    iovec stripData = { strip->getPixelData(), (size_t)strip->getPixelDataLength() };
+    mPacketIov.push_back(stripNumber);
+    mPacketIov.push_back(stripData);
+    remainingStrips.pop_front();
+  }
+  return encodedBytes;
+}
+
+bool PixelPusher::writePackets() {
+  size_t packets = mPacketStarts.size();
+  mPacketStarts.push_back(mPacketIov.size());
+  //a full socket buffer drops the rest of the batch; the throttle sees it as loss
+  return mTransport->send(&mPacketIov[0], &mPacketStarts[0], packets) == (int)packets;
+}
+
+void PixelPusher::recordPackets(FrameRecorder& recorder) {
+  //each packet is its header followed by (strip number, pixel data) pairs
+  for(size_t p = 0; p + 1 < mPacketStarts.size(); p++) {
+    for(size_t i = mPacketStarts[p] + 1; i + 1 < mPacketStarts[p+1]; i += 2) {
+      const unsigned char* stripNumberData = static_cast<const unsigned char*>(mPacketIov[i].iov_base);
+      int stripNumber = (stripNumberData[0] << 8) | stripNumberData[1];
+      recorder.record(mFrameBeganMicros, mMacKey, mFrameSequence, stripNumber, mStrips[stripNumber]->getPixelFormat(), FRAME_SOURCE_WIRE,
+                      static_cast<const unsigned char*>(mPacketIov[i+1].iov_base), mPacketIov[i+1].iov_len);
     }
   }
+}
+
+bool PixelPusher::needsPacing() {
+  return mUpdatePeriod > sBurstUpdatePeriod;
+}
+
+void PixelPusher::setBatchedSend(bool batchedSend) {
+  mBatchedSend = batchedSend;
+}
+
+bool PixelPusher::isBatchedSend() {
+  return mBatchedSend;
+}
+
+void PixelPusher::setTransport(std::shared_ptr<Transport> transport, const TransportOptions& options) {
+  mTransport = transport;
+  mTransportOptions = options;
+}
+
+std::shared_ptr<Transport> PixelPusher::getTransport() {
+  return mTransport;
+}
+
+void PixelPusher::setPixelFormat(PixelFormat format) {
+  //strips cannot change layout under the sender, so this only counts before they exist
+  if(!mStrips.empty()) {
+    PP_LOG_WARNING("PixelPusher %s already has its strips; set the pixel format before it starts sending", getMacAddress().c_str());
+    return;
   }
+  mPixelFormat = format;
+}
 
-  ofLogNotice("", "Closing Card Thread for PixelPusher %s", getMacAddress().c_str());
+void PixelPusher::setFrameRecorder(std::shared_ptr<FrameRecorder> recorder) {
+  std::atomic_store(&mFrameRecorder, recorder);
 }
 
 void PixelPusher::setPusherFlags(long pusherFlags) {
@@ -238,20 +447,43 @@ long PixelPusher::getDeltaSequence() {
 }
 
 void PixelPusher::increaseExtraDelay(long delay) {
-  mExtraDelayMsec += delay;
+  std::atomic_load(&mThrottle)->adjustExtraDelayMicros(delay * 1000);
 }
 
 void PixelPusher::decreaseExtraDelay(long delay) {
-  if (mExtraDelayMsec >= delay) {
-    mExtraDelayMsec -= delay;
-  }
-  else {
-    mExtraDelayMsec = 0;
-  }
+  std::atomic_load(&mThrottle)->adjustExtraDelayMicros(-delay * 1000);
 }
 
 long PixelPusher::getExtraDelay() {
-  return mExtraDelayMsec;
+  return getExtraDelayMicros() / 1000;
+}
+
+long PixelPusher::getExtraDelayMicros() {
+  //the controller owns the delay, so changes from either thread are never lost
+  return std::atomic_load(&mThrottle)->getExtraDelayMicros();
+}
+
+void PixelPusher::setThrottleController(std::shared_ptr<ThrottleController> throttle) {
+  throttle->setExtraDelayMicros(getExtraDelayMicros());
+  std::atomic_store(&mThrottle, throttle);
+}
+
+std::shared_ptr<ThrottleController> PixelPusher::getThrottleController() {
+  return std::atomic_load(&mThrottle);
+}
+
+void PixelPusher::updateThrottle() {
+  //called for every beacon; mDeltaSequence is the loss the controller just reported
+  unsigned long packetsSent = mPacketsSent.load();
+  long packets = packetsSent - mPacketsAtLastBeacon;
+  mPacketsAtLastBeacon = packetsSent;
+  long extraDelayMicros = std::atomic_load(&mThrottle)->update(mDeltaSequence, packets);
+  PP_TRACE(TRACE_THROTTLE, mMacKey, mDeltaSequence, extraDelayMicros);
+}
+
+long PixelPusher::getEncodedBytes() {
+  //bytes re-encoded by serialize() for the last frame that changed anything
+  return mEncodedBytes;
 }
 
 long PixelPusher::getUpdatePeriod() {
@@ -286,25 +518,48 @@ long PixelPusher::getPusherFlags() {
   return mPusherFlags;
 }
 
-void PixelPusher::copyHeader(std::shared_ptr<PixelPusher> pusher) {
+bool PixelPusher::copyHeader(std::shared_ptr<PixelPusher> pusher) {
+  std::shared_ptr<DeviceHeader> header = std::atomic_load(&pusher->mDeviceHeader);
+  bool moved = header->getIpAddressString() != getIpAddress() || pusher->mPort != mPort;
+  if(!moved) {
+    //same address, but the firmware revision lives in the header; a move swaps it in moveTransport()
+    std::atomic_store(&mDeviceHeader, header);
+  }
   mControllerId = pusher->mControllerId;
   mDeltaSequence = pusher->mDeltaSequence;
   mGroupId = pusher->mGroupId;
-  mMaxStripsPerPacket = pusher->mMaxStripsPerPacket;
+  mMaxStripsPerPacket = pusher->mMaxStripsPerPacket.load();
   mPowerTotal = pusher->mPowerTotal;
-  mUpdatePeriod = pusher->mUpdatePeriod;
+  mUpdatePeriod = pusher->mUpdatePeriod.load();
   mArtnetChannel = pusher->mArtnetChannel;
   mArtnetUniverse = pusher->mArtnetUniverse;
-  mPort = pusher->mPort;
   setPusherFlags(pusher->getPusherFlags());
   mPowerDomain = pusher->mPowerDomain;
+  mSegments = pusher->mSegments;
+  mFingerprint = pusher->mFingerprint;
+  return moved;
+}
+
+void PixelPusher::moveTransport(std::shared_ptr<PixelPusher> pusher) {
+  //take the sender off while the transport is pointed at the new address
+  if(mSenderEngine != NULL) {
+    mSenderEngine->removePusher(this);
+  }
+  std::atomic_store(&mDeviceHeader, std::atomic_load(&pusher->mDeviceHeader));
+  mPort = pusher->mPort;
+  if(mTransport) {
+    connectTransport();
+  }
+  if(mSenderEngine != NULL) {
+    mSenderEngine->addPusher(this);
+  }
 }
 
 void PixelPusher::updateVariables(std::shared_ptr<PixelPusher> pusher) {
   mDeltaSequence = pusher->mDeltaSequence;
-  mMaxStripsPerPacket = pusher->mMaxStripsPerPacket;
+  mMaxStripsPerPacket = pusher->mMaxStripsPerPacket.load();
   mPowerTotal = pusher->mPowerTotal;
-  mUpdatePeriod = pusher->mUpdatePeriod;
+  mUpdatePeriod = pusher->mUpdatePeriod.load();
 }
 
 bool PixelPusher::isEqual(std::shared_ptr<PixelPusher> pusher) {
@@ -315,7 +570,7 @@ bool PixelPusher::isEqual(std::shared_ptr<PixelPusher> pusher) {
 
   //include check for color of strips
   
-  if(getNumberOfStrips() != pusher->getNumberOfStrips()) {
+  if(mStripsAttached != pusher->mStripsAttached) {
     return false;
   }
 
@@ -343,40 +598,96 @@ bool PixelPusher::isEqual(std::shared_ptr<PixelPusher> pusher) {
   if(getPusherFlags() != pusher->getPusherFlags()) {
     return false;
   }
+
+  return true;
+}
+
+bool PixelPusher::hasSameLayout(std::shared_ptr<PixelPusher> pusher) {
+  return mStripsAttached == pusher->mStripsAttached && mPixelsPerStrip == pusher->mPixelsPerStrip && mStripFlags == pusher->mStripFlags;
+}
+
+uint64_t PixelPusher::getMacKey() {
+  return mMacKey;
+}
+
+uint64_t PixelPusher::getFingerprint() {
+  return mFingerprint;
+}
+
+long PixelPusher::getTimeoutMillis() {
+  return mTimeoutMillis;
+}
+
+void PixelPusher::setTimeoutMillis(long timeoutMillis) {
+  mTimeoutMillis = timeoutMillis;
+}
+
+BeaconStats PixelPusher::getBeaconStats() {
+  return mLiveness.getStats();
+}
+
+void PixelPusher::getMetrics(PusherMetricsSnapshot& snapshot) {
+  mMetrics.getSnapshot(snapshot);
+  snapshot.extraDelayMicros = getExtraDelayMicros();
 }
 
 bool PixelPusher::isAlive() {
-  if((std::clock() / CLOCKS_PER_SEC - mLastPingAt) < mTimeoutTime) {
-    return true;
-  }
-  else {
-    return false;
-  }
+  return mLiveness.getSilenceMicros(std::chrono::steady_clock::now()) < mTimeoutMillis * 1000LL;
 }
 
 void PixelPusher::createStrips() {
   for(int i = 0; i < mStripsAttached; i++) {
-    std::shared_ptr<Strip> newStrip(new Strip(i, mPixelsPerStrip));
+    //the format is fixed here, before the sender sees the strip, so serialize() never has to look at the flags
+    unsigned char flags = i < (int)mStripFlags.size() ? mStripFlags[i] : 0;
+    PixelFormat format = mPixelFormat;
+    if(flags & SFLAG_RGBOW) {
+      format = PIXEL_RGBOW;
+    }
+    else if(flags & SFLAG_WIDEPIXELS) {
+      format = PIXEL_RGB16;
+    }
+    std::shared_ptr<Strip> newStrip(new Strip(i, mPixelsPerStrip, format));
+    newStrip->setTripleBuffer(mTripleBuffer);
     mStrips.push_back(newStrip);
   }
 }
 
 void PixelPusher::createCardThread() {
+  //there is no thread per pusher any more; the shared SenderEngine drives service()
   createStrips();
 
-	mUdpConnection = new ofxUDPManager();
-	bool reuse_buff = 1;
-	mUdpConnection->Create();
-	mUdpConnection->Bind(mPort);
-
-  ofLogNotice("", "Connected to PixelPusher %s on port %d", getIpAddress().c_str(), mPort);
+  if(!mTransport) {
+    mTransport = Transport::create(TRANSPORT_DEFAULT);
+  }
+  if(!mTransport) {
+    PP_LOG_ERROR("No transport available for PixelPusher %s", getIpAddress().c_str());
+    return;
+  }
+  connectTransport();
   mPacketNumber = 0;
   mThreadExtraDelay = 0;
-  mCardThread = std::thread(&PixelPusher::sendPacket, this);
+  mThreadDelay = 16;
+  mTotalDelay = 16;
+  mSenderEngine = SenderEngine::getInstance();
+  mSenderEngine->addPusher(this);
+}
+
+bool PixelPusher::connectTransport() {
+  //connect() reopens the socket, so this also moves an open transport to a new address
+  if(!mTransport->connect(getIpAddress(), (unsigned short)mPort, mTransportOptions)) {
+    PP_LOG_ERROR("Could not open a %s socket to PixelPusher %s: error %d", mTransport->getName(), getIpAddress().c_str(), mTransport->getLastError());
+    return false;
+  }
+  PP_LOG_NOTICE("Sending to PixelPusher %s on port %d", getIpAddress().c_str(), (unsigned short)mPort);
+  return true;
 }
 
 void PixelPusher::destroyCardThread() {
-  if(mCardThread.joinable()) {
-    mCardThread.join();
+  if(mSenderEngine != NULL) {
+    mSenderEngine->removePusher(this);
+    mSenderEngine = NULL;
+  }
+  if(mTransport) {
+    mTransport->close();
   }
 }
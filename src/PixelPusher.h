@@ -15,24 +15,39 @@
 #include <thread>
 #include <mutex>
 #include <chrono>
+#include <atomic>
 #include "Strip.h"
 #include "DeviceHeader.h"
+#include "PacketPacer.h"
+#include "ThrottleController.h"
+#include "LivenessTracker.h"
+#include "PusherMetrics.h"
+#include "Transport.h"
+#include "FrameRecorder.h"
 
 #ifdef TARGET_WIN32
 #include "sdfWindows.hpp"
 #include "sdfServerSocket.hpp"
 #endif
 
-#include "ofxUDPManager.h"
+class SenderEngine;
 
 class PixelPusher {
+  friend class SenderEngine;
  public:
+  // silence after which a controller is considered gone
+  static const long sDefaultTimeoutMillis = 5000;
   PixelPusher(DeviceHeader* header);
+  ~PixelPusher();
   int getNumberOfStrips();
   std::deque<std::shared_ptr<Strip> > getStrips();
   std::deque<std::shared_ptr<Strip> > getTouchedStrips();
   std::shared_ptr<Strip> getStrip(int stripNumber);
   void addStrip(std::shared_ptr<Strip> strip);
+  void publish();
+  void submitFrame(unsigned long frame, long long deadlineMicros = 0);
+  unsigned long getLatchedFrame();
+  long long getLatchedAtMicros();
   int getMaxStripsPerPacket();
   int getPixelsPerStrip(int stripNumber);
   void setStripValues(int stripNumber, unsigned char red, unsigned char green, unsigned char blue);
@@ -45,6 +60,13 @@ class PixelPusher {
   void increaseExtraDelay(long delay);
   void decreaseExtraDelay(long delay);
   long getExtraDelay();
+  long getExtraDelayMicros();
+  void setThrottleController(std::shared_ptr<ThrottleController> throttle);
+  std::shared_ptr<ThrottleController> getThrottleController();
+  void updateThrottle();
+  long getEncodedBytes();
+  double getTargetPacketRate();
+  double getAchievedPacketRate();
   long getUpdatePeriod();
   short getArtnetChannel();
   short getArtnetUniverse();
@@ -54,48 +76,130 @@ class PixelPusher {
   long getSegments();
   void setPusherFlags(long pusherFlags);
   long getPusherFlags();
-  void copyHeader(std::shared_ptr<PixelPusher> pusher);
+  void updateCounters(const BeaconView& beacon);
+  uint64_t getMacKey();
+  uint64_t getFingerprint();
+  // copies what a changed beacon says; true if the controller moved, which moveTransport() then acts on
+  bool copyHeader(std::shared_ptr<PixelPusher> pusher);
+  // points the sender at the address and port of pusher; waits for a send in progress, so not under a lock
+  void moveTransport(std::shared_ptr<PixelPusher> pusher);
   void updateVariables(std::shared_ptr<PixelPusher> pusher);
   bool isEqual(std::shared_ptr<PixelPusher> pusher);
+  // same strips, lengths and strip flags, so the existing strips can be kept
+  bool hasSameLayout(std::shared_ptr<PixelPusher> pusher);
   bool isAlive();
+  long getTimeoutMillis();
+  void setTimeoutMillis(long timeoutMillis);
+  BeaconStats getBeaconStats();
+  void getMetrics(PusherMetricsSnapshot& snapshot);
+  void setBatchedSend(bool batchedSend);
+  bool isBatchedSend();
+  // one transport per pusher, set before createCardThread(); without it the default one is used
+  void setTransport(std::shared_ptr<Transport> transport, const TransportOptions& options);
+  std::shared_ptr<Transport> getTransport();
+  // format of the strips the controller does not flag as RGBOW or wide, set before createCardThread()
+  void setPixelFormat(PixelFormat format);
+  // logs every strip payload this pusher sends; an empty pointer stops recording
+  void setFrameRecorder(std::shared_ptr<FrameRecorder> recorder);
   void createCardThread();
   void destroyCardThread();
+  std::chrono::steady_clock::time_point service(std::chrono::steady_clock::time_point now);
  private:
   void createStrips();
-  void sendPacket();
-  static const int mTimeoutTime = 5;
+  bool connectTransport();
+  void applyBeacon(const BeaconView& beacon);
+  void beginFrame();
+  long packPacket(std::deque<std::shared_ptr<Strip> >& remainingStrips);
+  bool writePackets();
+  void recordPackets(FrameRecorder& recorder);
+  bool needsPacing();
   static const int mFrameLimit = 60;
-  ofxUDPManager* mUdpConnection;
+  // controllers slower than this (usec per update) get one packet at a time
+  static const long sBurstUpdatePeriod = 1000;
+  SenderEngine* mSenderEngine;
+  std::shared_ptr<Transport> mTransport;
+  TransportOptions mTransportOptions;
+  PixelFormat mPixelFormat;
+  // only touched through std::atomic_load / std::atomic_store
+  std::shared_ptr<FrameRecorder> mFrameRecorder;
+  // stamp the frame's records so a replay groups them back together
+  int64_t mFrameBeganMicros;
+  uint32_t mFrameSequence;
   long mPusherFlags;
-  DeviceHeader* mDeviceHeader;
+  // replaced when the controller moves; only touched through std::atomic_load / std::atomic_store
+  std::shared_ptr<DeviceHeader> mDeviceHeader;
   long mPacketNumber;
-  //unsigned char* mPacket;
-  std::vector<unsigned char> mPacket;
+  // one 4-byte packet number per packet of the frame being sent
+  std::vector<unsigned char> mPacketHeaders;
+  // per packet: header, then (strip number, pixel data) pairs pointing into the strips
+  std::vector<iovec> mPacketIov;
+  // index into mPacketIov where each packet starts
+  std::vector<size_t> mPacketStarts;
+  bool mBatchedSend;
+  // the last send failed; keeps a dead link from logging once per packet
+  bool mSendFailing;
   short mPort;
   short mStripsAttached;
-  short mMaxStripsPerPacket;
   short mPixelsPerStrip;
-  long mUpdatePeriod;
+  // refreshed by every beacon on the discovery thread, read by the sender
+  std::atomic<short> mMaxStripsPerPacket;
+  std::atomic<long> mUpdatePeriod;
+  // mMaxStripsPerPacket as of beginFrame(), so a beacon cannot resize a frame halfway
+  int mFrameStripsPerPacket;
   long mPowerTotal;
   long mDeltaSequence;
   long mControllerId;
   long mGroupId;
   short mArtnetUniverse;
   short mArtnetChannel;
-  long mExtraDelayMsec;
+  // owns the extra delay; replaced by the app while discovery and the sender
+  // use it, so only touched through std::atomic_load/std::atomic_store
+  std::shared_ptr<ThrottleController> mThrottle;
+  std::atomic<unsigned long> mPacketsSent;
+  unsigned long mPacketsAtLastBeacon;
   bool mMulticast;
   bool mMulticastPrimary;
   bool mAutothrottle;
   long mSegments;
   long mPowerDomain;
-  double mLastPingAt;
-  double mResetSentAt;
+  LivenessTracker mLiveness;
+  PusherMetrics mMetrics;
+  // the frame being sent was newly acquired, so finishing it counts as a frame sent
+  bool mFrameAcquired;
+  std::atomic<long> mTimeoutMillis;
+  std::chrono::steady_clock::time_point mResetSentAt;
   bool mSendReset;
   long mThreadDelay;
   long mThreadExtraDelay;
   long mTotalDelay;
-  bool mRunCardThread;
-  std::thread mCardThread;
+  long mEncodedBytes;
+  // strips of the current frame that still have to go out
+  std::deque<std::shared_ptr<Strip> > mRemainingStrips;
+  size_t mPacketLimit;
+  void publish(unsigned long frame, long long deadlineMicros);
+  void latchFrame(std::chrono::steady_clock::time_point now);
+  bool isFrameOverdue(std::chrono::steady_clock::time_point now);
+  std::chrono::steady_clock::time_point getNextDeadline(std::chrono::steady_clock::time_point now);
+  // group frame barrier: the app tags a frame, the sender records when it went out
+  struct FrameTag {
+    unsigned long frame;
+    // steady_clock micros by which every packet of the frame must be out, or 0
+    long long deadlineMicros;
+  };
+  // one tag per triple buffer slot, handed over with the slot itself
+  FrameTag mSlotTags[3];
+  unsigned long mFrameInFlight;
+  long long mFrameDeadline;
+  bool mFrameLatched;
+  std::atomic<unsigned long> mLatchedFrame;
+  std::atomic<long long> mLatchedAt;
+  PacketPacer mPacer;
+  long mFrameEncodedBytes;
   std::vector<unsigned char> mStripFlags;
+  // packed MAC and a hash of the beacon fields that define this controller
+  uint64_t mMacKey;
+  uint64_t mFingerprint;
   std::deque<std::shared_ptr<Strip> > mStrips;
+  // shared by all strips so a frame is handed to the card thread as a whole
+  std::shared_ptr<TripleBuffer> mTripleBuffer;
 };
@@ -0,0 +1,328 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "PixelPusherEmulator.h"
+#include "PixelPusherLog.h"
+#include "BeaconView.h"
+#include "DeviceHeader.h"
+#include <algorithm>
+#include <cstring>
+
+#ifndef TARGET_WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const unsigned char sDefaultMac[6] = { 0xd8, 0x80, 0x39, 0x00, 0x00, 0x01 };
+
+EmulatorConfig::EmulatorConfig() {
+  memcpy(macAddress, sDefaultMac, 6);
+  address = "127.0.0.1";
+  port = 0;
+  beaconAddress = "127.0.0.1";
+  beaconPort = 7331;
+  beaconIntervalMillis = 1000;
+  strips = 8;
+  pixelsPerStrip = 240;
+  maxStripsPerPacket = 2;
+  updatePeriod = 1000;
+  softwareRevision = 140;
+  groupId = 0;
+  controllerId = 0;
+  stripFlags = 0;
+  pusherFlags = 0;
+}
+
+//the wire is little endian regardless of the host
+static void writeShort(unsigned char* data, long value) {
+  data[0] = value & 0xFF;
+  data[1] = (value >> 8) & 0xFF;
+}
+
+static void writeLong(unsigned char* data, long value) {
+  for(int i = 0; i < 4; i++) {
+    data[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+PixelPusherEmulator::PixelPusherEmulator(const EmulatorConfig& config) {
+  mConfig = config;
+  mConfig.strips = std::max(1, std::min(mConfig.strips, 255));
+  mConfig.maxStripsPerPacket = std::max(1, mConfig.maxStripsPerPacket);
+  mStripBytes = 3 * mConfig.pixelsPerStrip;
+  mSocket = -1;
+  mBeaconSocket = -1;
+  mWakePipe[0] = mWakePipe[1] = -1;
+  mRunning = false;
+  //room for one more strip than advertised, so oversized packets show up as malformed
+  mPacket.assign(4 + (mConfig.maxStripsPerPacket + 1) * (2 + mStripBytes), 0);
+
+  mStats.packets = 0;
+  mStats.bytes = 0;
+  mStats.sequenceGaps = 0;
+  mStats.outOfOrder = 0;
+  mStats.malformed = 0;
+  mStats.beaconsSent = 0;
+  EmulatorStripStats strip = { 0, 0.0, 0, 0, 0 };
+  mStats.strips.assign(mConfig.strips, strip);
+  mSequenceStarted = false;
+  mNextSequence = 0;
+  mDeltaSequence = 0;
+  for(int i = 0; i < mConfig.strips; i++) {
+    mArrivals.push_back(std::make_shared<LivenessTracker>());
+  }
+  mFirstUpdateMicros.assign(mConfig.strips, 0);
+  mPixels.assign(mConfig.strips, std::vector<unsigned char>(mStripBytes, 0));
+  mExpectedPixels.assign(mConfig.strips, std::vector<unsigned char>());
+}
+
+PixelPusherEmulator::~PixelPusherEmulator() {
+  stop();
+}
+
+#ifdef TARGET_WIN32
+
+bool PixelPusherEmulator::start() {
+  PP_LOG_ERROR("PixelPusherEmulator needs POSIX sockets");
+  return false;
+}
+
+void PixelPusherEmulator::stop() {
+}
+
+void PixelPusherEmulator::run() {
+}
+
+void PixelPusherEmulator::sendBeacon() {
+}
+
+int PixelPusherEmulator::buildBeacon(unsigned char* beacon) {
+  return 0;
+}
+
+#else
+
+bool PixelPusherEmulator::start() {
+  if(mRunning) {
+    return true;
+  }
+  mSocket = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(mConfig.port);
+  inet_pton(AF_INET, mConfig.address.c_str(), &address.sin_addr);
+  if(mSocket < 0 || bind(mSocket, (sockaddr*)&address, sizeof(address)) != 0) {
+    PP_LOG_ERROR("PixelPusherEmulator could not bind %s:%d", mConfig.address.c_str(), mConfig.port);
+    stop();
+    return false;
+  }
+  socklen_t length = sizeof(address);
+  getsockname(mSocket, (sockaddr*)&address, &length);
+  mConfig.port = ntohs(address.sin_port);
+  fcntl(mSocket, F_SETFL, fcntl(mSocket, F_GETFL, 0) | O_NONBLOCK);
+  //a full frame can land at once; don't let the kernel drop it
+  int receiveBuffer = 4 << 20;
+  setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+
+  mBeaconSocket = socket(AF_INET, SOCK_DGRAM, 0);
+  int broadcast = 1;
+  setsockopt(mBeaconSocket, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+  if(pipe(mWakePipe) != 0) {
+    mWakePipe[0] = mWakePipe[1] = -1;
+  }
+
+  PP_LOG_NOTICE("PixelPusherEmulator listening on %s:%d", mConfig.address.c_str(), mConfig.port);
+  mRunning = true;
+  mThread = std::thread(&PixelPusherEmulator::run, this);
+  return true;
+}
+
+void PixelPusherEmulator::stop() {
+  mRunning = false;
+  if(mWakePipe[1] >= 0) {
+    char wake = 0;
+    if(write(mWakePipe[1], &wake, 1) < 0) {
+      PP_LOG_WARNING("PixelPusherEmulator could not wake its thread");
+    }
+  }
+  if(mThread.joinable()) {
+    mThread.join();
+  }
+  int* descriptors[4] = { &mSocket, &mBeaconSocket, &mWakePipe[0], &mWakePipe[1] };
+  for(int i = 0; i < 4; i++) {
+    if(*descriptors[i] >= 0) {
+      close(*descriptors[i]);
+      *descriptors[i] = -1;
+    }
+  }
+}
+
+void PixelPusherEmulator::run() {
+  //receive until the next beacon is due, then announce and start over
+  std::chrono::steady_clock::time_point nextBeacon = std::chrono::steady_clock::now();
+  while(mRunning) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(now >= nextBeacon) {
+      sendBeacon();
+      nextBeacon = now + std::chrono::milliseconds(mConfig.beaconIntervalMillis);
+    }
+    int timeoutMillis = (int)std::chrono::duration_cast<std::chrono::milliseconds>(nextBeacon - now).count() + 1;
+    pollfd fds[2];
+    fds[0].fd = mSocket;
+    fds[0].events = POLLIN;
+    fds[1].fd = mWakePipe[0];
+    fds[1].events = POLLIN;
+    if(poll(fds, mWakePipe[0] >= 0 ? 2 : 1, timeoutMillis) <= 0 || !(fds[0].revents & POLLIN)) {
+      continue;
+    }
+    int received;
+    while((received = recv(mSocket, &mPacket[0], mPacket.size(), 0)) > 0) {
+      handlePacket(&mPacket[0], received, std::chrono::steady_clock::now());
+    }
+  }
+}
+
+void PixelPusherEmulator::sendBeacon() {
+  unsigned char beacon[BeaconView::sHeaderLength + 44 + BeaconView::sMaxStrips];
+  int length = buildBeacon(beacon);
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(mConfig.beaconPort);
+  inet_pton(AF_INET, mConfig.beaconAddress.c_str(), &address.sin_addr);
+  if(sendto(mBeaconSocket, beacon, length, 0, (sockaddr*)&address, sizeof(address)) != length) {
+    PP_LOG_WARNING("PixelPusherEmulator could not send a beacon to %s:%d", mConfig.beaconAddress.c_str(), mConfig.beaconPort);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mStatsMutex);
+  mStats.beaconsSent++;
+}
+
+int PixelPusherEmulator::buildBeacon(unsigned char* beacon) {
+  //same layout BeaconView::parse reads
+  int flagCount = std::max(mConfig.strips, 8);
+  int length = BeaconView::sHeaderLength + 44 + flagCount;
+  memset(beacon, 0, length);
+  memcpy(&beacon[0], mConfig.macAddress, 6);
+  sockaddr_in address;
+  inet_pton(AF_INET, mConfig.address.c_str(), &address.sin_addr);
+  memcpy(&beacon[6], &address.sin_addr, 4);
+  beacon[10] = PIXELPUSHER;
+  beacon[11] = 1;
+  writeShort(&beacon[12], 2);
+  writeShort(&beacon[14], 1);
+  writeShort(&beacon[16], 1);
+  writeShort(&beacon[18], mConfig.softwareRevision);
+  writeLong(&beacon[20], 100000000);
+
+  unsigned char* remainder = &beacon[BeaconView::sHeaderLength];
+  remainder[0] = mConfig.strips;
+  remainder[1] = mConfig.maxStripsPerPacket;
+  writeShort(&remainder[2], mConfig.pixelsPerStrip);
+  writeLong(&remainder[4], mConfig.updatePeriod);
+  {
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    writeLong(&remainder[12], mDeltaSequence);
+    mDeltaSequence = 0;
+  }
+  writeLong(&remainder[16], mConfig.controllerId);
+  writeLong(&remainder[20], mConfig.groupId);
+  writeShort(&remainder[28], mConfig.port);
+  memset(&remainder[30], mConfig.stripFlags, flagCount);
+  writeLong(&remainder[32 + flagCount], mConfig.pusherFlags);
+  return length;
+}
+
+#endif
+
+void PixelPusherEmulator::handlePacket(const unsigned char* packet, int length, std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mStatsMutex);
+  mStats.packets++;
+  mStats.bytes += length;
+  int stripLength = 2 + mStripBytes;
+  if(length < 4 + stripLength || (length - 4) % stripLength != 0 || (length - 4) / stripLength > mConfig.maxStripsPerPacket) {
+    mStats.malformed++;
+    return;
+  }
+
+  uint32_t sequence = ((uint32_t)packet[0] << 24) | ((uint32_t)packet[1] << 16) | ((uint32_t)packet[2] << 8) | packet[3];
+  if(mSequenceStarted && sequence != mNextSequence) {
+    if((int32_t)(sequence - mNextSequence) > 0) {
+      mStats.sequenceGaps += sequence - mNextSequence;
+      mDeltaSequence += sequence - mNextSequence;
+    }
+    else {
+      mStats.outOfOrder++;
+    }
+  }
+  if(!mSequenceStarted || (int32_t)(sequence - mNextSequence) >= 0) {
+    mNextSequence = sequence + 1;
+  }
+  mSequenceStarted = true;
+
+  long long nowMicros = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+  for(const unsigned char* strip = packet + 4; strip < packet + length; strip += stripLength) {
+    int stripNumber = (strip[0] << 8) | strip[1];
+    if(stripNumber >= mConfig.strips) {
+      mStats.malformed++;
+      continue;
+    }
+    EmulatorStripStats& stats = mStats.strips[stripNumber];
+    mPixels[stripNumber].assign(strip + 2, strip + stripLength);
+    const std::vector<unsigned char>& expected = mExpectedPixels[stripNumber];
+    if(!expected.empty() && expected != mPixels[stripNumber]) {
+      stats.mismatches++;
+    }
+    mArrivals[stripNumber]->recordBeacon(now);
+    if(stats.updates == 0) {
+      mFirstUpdateMicros[stripNumber] = nowMicros;
+    }
+    stats.updates++;
+  }
+}
+
+bool PixelPusherEmulator::isRunning() {
+  return mRunning;
+}
+
+int PixelPusherEmulator::getPort() {
+  return mConfig.port;
+}
+
+uint64_t PixelPusherEmulator::getMacKey() {
+  uint64_t key = 0;
+  for(int i = 0; i < 6; i++) {
+    key = (key << 8) | mConfig.macAddress[i];
+  }
+  return key;
+}
+
+void PixelPusherEmulator::getStats(EmulatorStats& stats) {
+  std::lock_guard<std::mutex> lock(mStatsMutex);
+  stats = mStats;
+  for(size_t i = 0; i < stats.strips.size(); i++) {
+    BeaconStats arrivals = mArrivals[i]->getStats();
+    EmulatorStripStats& strip = stats.strips[i];
+    strip.meanIntervalMicros = arrivals.meanIntervalMicros;
+    strip.jitterMicros = arrivals.jitterMicros;
+    long long span = arrivals.lastSeenMicros - mFirstUpdateMicros[i];
+    strip.updateRate = strip.updates > 1 && span > 0 ? (strip.updates - 1) * 1e6 / span : 0.0;
+  }
+}
+
+void PixelPusherEmulator::getStripPixels(int strip, std::vector<unsigned char>& pixels) {
+  std::lock_guard<std::mutex> lock(mStatsMutex);
+  pixels = mPixels.at(strip);
+}
+
+void PixelPusherEmulator::setExpectedPixels(int strip, const std::vector<unsigned char>& pixels) {
+  std::lock_guard<std::mutex> lock(mStatsMutex);
+  mExpectedPixels.at(strip) = pixels;
+}
@@ -0,0 +1,111 @@
+/*
+ * PixelPusherEmulator
+ *
+ * A software PixelPusher for load and regression testing without hardware.
+ * It announces itself with regular discovery beacons, receives the pixel
+ * packets sent to its advertised port and decodes them the way a controller
+ * would, keeping per-strip update rate, arrival jitter, packet sequence gaps
+ * and payload checks.  Lost packets are reported back in the beacons'
+ * delta sequence, so throttling reacts as it would on a real network.
+ *
+ * Several emulators with different MACs and ports can run side by side on
+ * loopback.  POSIX only; on Windows start() fails.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include "LivenessTracker.h"
+
+struct EmulatorConfig {
+  EmulatorConfig();
+  unsigned char macAddress[6];
+  // address the data socket binds to and the beacons advertise
+  std::string address;
+  // advertised data port; 0 picks a free one
+  int port;
+  // where beacons go: loopback, a unicast host or a broadcast address
+  std::string beaconAddress;
+  int beaconPort;
+  int beaconIntervalMillis;
+  int strips;
+  int pixelsPerStrip;
+  int maxStripsPerPacket;
+  // usec between packets the controller asks for
+  long updatePeriod;
+  short softwareRevision;
+  long groupId;
+  long controllerId;
+  unsigned char stripFlags;
+  long pusherFlags;
+};
+
+struct EmulatorStripStats {
+  unsigned long updates;
+  // updates per second between the first and the latest one
+  double updateRate;
+  long long meanIntervalMicros;
+  long long jitterMicros;
+  // updates whose pixels differed from setExpectedPixels()
+  unsigned long mismatches;
+};
+
+struct EmulatorStats {
+  unsigned long long packets;
+  unsigned long long bytes;
+  // packet numbers skipped over, i.e. packets lost or still in flight
+  unsigned long long sequenceGaps;
+  unsigned long long outOfOrder;
+  // packets whose length does not split into whole strips
+  unsigned long long malformed;
+  unsigned long beaconsSent;
+  std::vector<EmulatorStripStats> strips;
+};
+
+class PixelPusherEmulator {
+ public:
+  PixelPusherEmulator(const EmulatorConfig& config);
+  ~PixelPusherEmulator();
+  bool start();
+  void stop();
+  bool isRunning();
+  int getPort();
+  uint64_t getMacKey();
+  void getStats(EmulatorStats& stats);
+  // wire bytes (3 per pixel) the latest update carried for a strip
+  void getStripPixels(int strip, std::vector<unsigned char>& pixels);
+  // every following update of the strip is compared with these bytes
+  void setExpectedPixels(int strip, const std::vector<unsigned char>& pixels);
+ private:
+  void run();
+  void sendBeacon();
+  void handlePacket(const unsigned char* packet, int length, std::chrono::steady_clock::time_point now);
+  int buildBeacon(unsigned char* beacon);
+  EmulatorConfig mConfig;
+  int mStripBytes;
+  int mSocket;
+  int mBeaconSocket;
+  int mWakePipe[2];
+  std::thread mThread;
+  std::atomic<bool> mRunning;
+  std::vector<unsigned char> mPacket;
+
+  // guards everything below; taken per packet, which is fine for a test tool
+  std::mutex mStatsMutex;
+  EmulatorStats mStats;
+  bool mSequenceStarted;
+  uint32_t mNextSequence;
+  // gaps since the last beacon, reported as its delta sequence
+  long mDeltaSequence;
+  std::vector<std::shared_ptr<LivenessTracker> > mArrivals;
+  std::vector<long long> mFirstUpdateMicros;
+  std::vector<std::vector<unsigned char> > mPixels;
+  std::vector<std::vector<unsigned char> > mExpectedPixels;
+};
@@ -0,0 +1,77 @@
+/*
+ * PixelPusherLog
+ *
+ * Logging for the per-packet and per-beacon paths, gated at compile time.
+ * Calls below PIXELPUSHER_LOG_LEVEL expand to nothing, arguments included,
+ * so getMacAddress() and friends cost nothing in a release build.  Build
+ * with -DPIXELPUSHER_LOG_LEVEL=PIXELPUSHER_LEVEL_VERBOSE to get them back.
+ * Events worth keeping in production go to the TraceBuffer instead.
+ *
+ * Define PIXELPUSHER_HEADLESS to print to stderr instead of ofLog, so the
+ * logging code needs nothing from openFrameworks.
+ */
+
+#pragma once
+
+#include "TraceBuffer.h"
+
+#ifdef PIXELPUSHER_HEADLESS
+#include <cstdio>
+// every call site passes a literal format, so the prefix concatenates onto it
+#define PIXELPUSHER_PRINT(level, ...) (std::fprintf(stderr, "[" level "] " __VA_ARGS__), std::fputc('\n', stderr))
+#define PIXELPUSHER_LOG_VERBOSE(...) PIXELPUSHER_PRINT("verbose", __VA_ARGS__)
+#define PIXELPUSHER_LOG_NOTICE(...) PIXELPUSHER_PRINT("notice", __VA_ARGS__)
+#define PIXELPUSHER_LOG_WARNING(...) PIXELPUSHER_PRINT("warning", __VA_ARGS__)
+#define PIXELPUSHER_LOG_ERROR(...) PIXELPUSHER_PRINT("error", __VA_ARGS__)
+#else
+#include "ofLog.h"
+#define PIXELPUSHER_LOG_VERBOSE(...) ofLogVerbose("", __VA_ARGS__)
+#define PIXELPUSHER_LOG_NOTICE(...) ofLogNotice("", __VA_ARGS__)
+#define PIXELPUSHER_LOG_WARNING(...) ofLogWarning("", __VA_ARGS__)
+#define PIXELPUSHER_LOG_ERROR(...) ofLogError("", __VA_ARGS__)
+#endif
+
+#define PIXELPUSHER_LEVEL_VERBOSE 0
+#define PIXELPUSHER_LEVEL_NOTICE 1
+#define PIXELPUSHER_LEVEL_WARNING 2
+#define PIXELPUSHER_LEVEL_ERROR 3
+#define PIXELPUSHER_LEVEL_SILENT 4
+
+#ifndef PIXELPUSHER_LOG_LEVEL
+#define PIXELPUSHER_LOG_LEVEL PIXELPUSHER_LEVEL_NOTICE
+#endif
+
+// set to 0 to compile the trace points out as well
+#ifndef PIXELPUSHER_TRACE
+#define PIXELPUSHER_TRACE 1
+#endif
+
+#if PIXELPUSHER_LOG_LEVEL <= PIXELPUSHER_LEVEL_VERBOSE
+#define PP_LOG_VERBOSE(...) PIXELPUSHER_LOG_VERBOSE(__VA_ARGS__)
+#else
+#define PP_LOG_VERBOSE(...) ((void)0)
+#endif
+
+#if PIXELPUSHER_LOG_LEVEL <= PIXELPUSHER_LEVEL_NOTICE
+#define PP_LOG_NOTICE(...) PIXELPUSHER_LOG_NOTICE(__VA_ARGS__)
+#else
+#define PP_LOG_NOTICE(...) ((void)0)
+#endif
+
+#if PIXELPUSHER_LOG_LEVEL <= PIXELPUSHER_LEVEL_WARNING
+#define PP_LOG_WARNING(...) PIXELPUSHER_LOG_WARNING(__VA_ARGS__)
+#else
+#define PP_LOG_WARNING(...) ((void)0)
+#endif
+
+#if PIXELPUSHER_LOG_LEVEL <= PIXELPUSHER_LEVEL_ERROR
+#define PP_LOG_ERROR(...) PIXELPUSHER_LOG_ERROR(__VA_ARGS__)
+#else
+#define PP_LOG_ERROR(...) ((void)0)
+#endif
+
+#if PIXELPUSHER_TRACE
+#define PP_TRACE(event, pusher, arg0, arg1) TraceBuffer::getInstance()->record((event), (pusher), (arg0), (arg1))
+#else
+#define PP_TRACE(event, pusher, arg0, arg1) ((void)0)
+#endif
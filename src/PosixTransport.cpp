@@ -0,0 +1,162 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "PosixTransport.h"
+
+#ifndef TARGET_WIN32
+
+#include "PixelPusherLog.h"
+#include <cerrno>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+PosixTransport::PosixTransport() {
+  mSocket = -1;
+  mLastError = 0;
+}
+
+PosixTransport::~PosixTransport() {
+  close();
+}
+
+bool PosixTransport::open(const TransportOptions& options) {
+  close();
+  mSocket = socket(AF_INET, SOCK_DGRAM, 0);
+  if(mSocket < 0) {
+    return fail();
+  }
+  if(options.nonBlocking) {
+    fcntl(mSocket, F_SETFL, fcntl(mSocket, F_GETFL, 0) | O_NONBLOCK);
+  }
+  //the kernel may round or cap these; failing to set them is not fatal
+  if(options.sendBufferBytes > 0) {
+    setsockopt(mSocket, SOL_SOCKET, SO_SNDBUF, &options.sendBufferBytes, sizeof(options.sendBufferBytes));
+  }
+  if(options.receiveBufferBytes > 0) {
+    setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &options.receiveBufferBytes, sizeof(options.receiveBufferBytes));
+  }
+  if(options.dscp >= 0) {
+    //DSCP is the upper six bits of the TOS byte
+    int tos = (options.dscp & 0x3F) << 2;
+    if(setsockopt(mSocket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) != 0) {
+      PP_LOG_WARNING("PosixTransport could not set DSCP %d", options.dscp);
+    }
+  }
+  return true;
+}
+
+bool PosixTransport::connect(const std::string& address, int port, const TransportOptions& options) {
+  if(!open(options)) {
+    return false;
+  }
+  sockaddr_in destination;
+  memset(&destination, 0, sizeof(destination));
+  destination.sin_family = AF_INET;
+  destination.sin_port = htons((unsigned short)port);
+  if(inet_pton(AF_INET, address.c_str(), &destination.sin_addr) != 1) {
+    mLastError = EINVAL;
+    close();
+    return false;
+  }
+  if(::connect(mSocket, (sockaddr*)&destination, sizeof(destination)) != 0) {
+    return fail();
+  }
+  return true;
+}
+
+bool PosixTransport::bind(int port, const TransportOptions& options) {
+  if(!open(options)) {
+    return false;
+  }
+  int reuse = 1;
+  setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons((unsigned short)port);
+  if(::bind(mSocket, (sockaddr*)&local, sizeof(local)) != 0) {
+    return fail();
+  }
+  return true;
+}
+
+void PosixTransport::close() {
+  if(mSocket >= 0) {
+    ::close(mSocket);
+    mSocket = -1;
+  }
+}
+
+bool PosixTransport::fail() {
+  mLastError = errno;
+  close();
+  return false;
+}
+
+int PosixTransport::send(const iovec* iov, const size_t* starts, size_t packets) {
+  if(mSocket < 0) {
+    mLastError = EBADF;
+    return 0;
+  }
+#ifdef __linux__
+  //the whole batch goes to the kernel in one sendmmsg() call
+  mMessages.resize(packets);
+  memset(mMessages.data(), 0, packets * sizeof(mmsghdr));
+  for(size_t p = 0; p < packets; p++) {
+    mMessages[p].msg_hdr.msg_iov = const_cast<iovec*>(&iov[starts[p]]);
+    mMessages[p].msg_hdr.msg_iovlen = starts[p+1] - starts[p];
+  }
+  size_t sent = 0;
+  while(sent < packets) {
+    int result = sendmmsg(mSocket, &mMessages[sent], packets - sent, 0);
+    if(result <= 0) {
+      mLastError = result < 0 ? errno : EIO;
+      break;
+    }
+    sent += result;
+  }
+  return sent;
+#else
+  for(size_t p = 0; p < packets; p++) {
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = const_cast<iovec*>(&iov[starts[p]]);
+    message.msg_iovlen = starts[p+1] - starts[p];
+    if(sendmsg(mSocket, &message, 0) < 0) {
+      mLastError = errno;
+      return p;
+    }
+  }
+  return packets;
+#endif
+}
+
+int PosixTransport::receive(unsigned char* buffer, int length) {
+  int received = recv(mSocket, buffer, length, 0);
+  if(received < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    mLastError = errno;
+  }
+  return received;
+}
+
+int PosixTransport::getDescriptor() {
+  return mSocket;
+}
+
+int PosixTransport::getLastError() {
+  return mLastError;
+}
+
+const char* PosixTransport::getName() {
+  return "posix";
+}
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * PosixTransport
+ *
+ * Transport on a plain BSD socket.  Sending sockets are connected to their
+ * controller, so the kernel resolves the route once instead of per packet,
+ * and a batch goes out in one sendmmsg() call on Linux.  Not available on
+ * Windows.
+ */
+
+#pragma once
+
+#include "Transport.h"
+#include <vector>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+class PosixTransport : public Transport {
+ public:
+  PosixTransport();
+  ~PosixTransport();
+  bool connect(const std::string& address, int port, const TransportOptions& options);
+  bool bind(int port, const TransportOptions& options);
+  void close();
+  int send(const iovec* iov, const size_t* starts, size_t packets);
+  int receive(unsigned char* buffer, int length);
+  int getDescriptor();
+  int getLastError();
+  const char* getName();
+ private:
+  bool open(const TransportOptions& options);
+  bool fail();
+  int mSocket;
+  int mLastError;
+#ifdef __linux__
+  std::vector<mmsghdr> mMessages;
+#endif
+};
@@ -0,0 +1,159 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "PusherMetrics.h"
+#include <algorithm>
+
+PusherMetricsSnapshot::PusherMetricsSnapshot() {
+  pushers = 0;
+  packetsPerSecond = 0.0;
+  bytesPerSecond = 0.0;
+  packetsSent = 0;
+  bytesSent = 0;
+  sendErrors = 0;
+  framesSubmitted = 0;
+  framesSent = 0;
+  framesSkipped = 0;
+  framesMissed = 0;
+  serializeNanos = 0;
+  for(int i = 0; i < sLatencyBuckets; i++) {
+    sendLatency[i] = 0;
+  }
+  totalDelayMicros = 0;
+  extraDelayMicros = 0;
+}
+
+void PusherMetricsSnapshot::add(const PusherMetricsSnapshot& other) {
+  pushers += other.pushers;
+  packetsPerSecond += other.packetsPerSecond;
+  bytesPerSecond += other.bytesPerSecond;
+  packetsSent += other.packetsSent;
+  bytesSent += other.bytesSent;
+  sendErrors += other.sendErrors;
+  framesSubmitted += other.framesSubmitted;
+  framesSent += other.framesSent;
+  framesSkipped += other.framesSkipped;
+  framesMissed += other.framesMissed;
+  serializeNanos += other.serializeNanos;
+  for(int i = 0; i < sLatencyBuckets; i++) {
+    sendLatency[i] += other.sendLatency[i];
+  }
+  totalDelayMicros = std::max(totalDelayMicros, other.totalDelayMicros);
+  extraDelayMicros = std::max(extraDelayMicros, other.extraDelayMicros);
+}
+
+long long PusherMetricsSnapshot::getLatencyPercentileMicros(double percentile) const {
+  //upper edge of the bucket holding the percentile, 0 if nothing was sent
+  unsigned long long total = 0;
+  for(int i = 0; i < sLatencyBuckets; i++) {
+    total += sendLatency[i];
+  }
+  if(total == 0) {
+    return 0;
+  }
+  unsigned long long rank = (unsigned long long)(std::min(std::max(percentile, 0.0), 1.0) * (total - 1)) + 1;
+  unsigned long long seen = 0;
+  for(int i = 0; i < sLatencyBuckets; i++) {
+    seen += sendLatency[i];
+    if(seen >= rank) {
+      return 2LL << i;
+    }
+  }
+  return 2LL << (sLatencyBuckets - 1);
+}
+
+PusherMetrics::PusherMetrics() {
+  mPacketsSent = 0;
+  mBytesSent = 0;
+  mSendErrors = 0;
+  mFramesSubmitted = 0;
+  mFramesSent = 0;
+  mFramesSkipped = 0;
+  mFramesMissed = 0;
+  mSerializeNanos = 0;
+  for(int i = 0; i < PusherMetricsSnapshot::sLatencyBuckets; i++) {
+    mSendLatency[i] = 0;
+  }
+  mPacketsPerSecond = 0.0;
+  mBytesPerSecond = 0.0;
+  mTotalDelayMicros = 0;
+  mRateUpdatedMicros = 0;
+  mWindowStarted = false;
+  mWindowPackets = 0;
+  mWindowBytes = 0;
+}
+
+void PusherMetrics::recordSubmitted(bool skippedPrevious) {
+  mFramesSubmitted.fetch_add(1, std::memory_order_relaxed);
+  if(skippedPrevious) {
+    mFramesSkipped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void PusherMetrics::recordFrameSent() {
+  mFramesSent.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PusherMetrics::recordFrameMissed() {
+  mFramesMissed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PusherMetrics::recordSerialize(long long nanos) {
+  mSerializeNanos.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+void PusherMetrics::recordSend(int packets, long long bytes, long long latencyMicros, bool failed, TimePoint now) {
+  mPacketsSent.fetch_add(packets, std::memory_order_relaxed);
+  mBytesSent.fetch_add(bytes, std::memory_order_relaxed);
+  if(failed) {
+    mSendErrors.fetch_add(1, std::memory_order_relaxed);
+  }
+  int bucket = 0;
+  while(bucket < PusherMetricsSnapshot::sLatencyBuckets - 1 && (latencyMicros >> (bucket + 1)) > 0) {
+    bucket++;
+  }
+  mSendLatency[bucket].fetch_add(1, std::memory_order_relaxed);
+
+  if(!mWindowStarted) {
+    mWindowStarted = true;
+    mWindowStart = now;
+  }
+  mWindowPackets += packets;
+  mWindowBytes += bytes;
+  long long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - mWindowStart).count();
+  if(elapsed >= sRateWindowMicros) {
+    mPacketsPerSecond.store(mWindowPackets * 1e6 / elapsed, std::memory_order_relaxed);
+    mBytesPerSecond.store(mWindowBytes * 1e6 / elapsed, std::memory_order_relaxed);
+    mRateUpdatedMicros.store(std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count(), std::memory_order_relaxed);
+    mWindowStart = now;
+    mWindowPackets = 0;
+    mWindowBytes = 0;
+  }
+}
+
+void PusherMetrics::setTotalDelayMicros(long totalDelayMicros) {
+  mTotalDelayMicros.store(totalDelayMicros, std::memory_order_relaxed);
+}
+
+void PusherMetrics::getSnapshot(PusherMetricsSnapshot& snapshot) {
+  snapshot.pushers = 1;
+  //a pusher with nothing to send stops updating its window
+  long long now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  bool fresh = now - mRateUpdatedMicros.load(std::memory_order_relaxed) < 2 * sRateWindowMicros;
+  snapshot.packetsPerSecond = fresh ? mPacketsPerSecond.load(std::memory_order_relaxed) : 0.0;
+  snapshot.bytesPerSecond = fresh ? mBytesPerSecond.load(std::memory_order_relaxed) : 0.0;
+  snapshot.packetsSent = mPacketsSent.load(std::memory_order_relaxed);
+  snapshot.bytesSent = mBytesSent.load(std::memory_order_relaxed);
+  snapshot.sendErrors = mSendErrors.load(std::memory_order_relaxed);
+  snapshot.framesSubmitted = mFramesSubmitted.load(std::memory_order_relaxed);
+  snapshot.framesSent = mFramesSent.load(std::memory_order_relaxed);
+  snapshot.framesSkipped = mFramesSkipped.load(std::memory_order_relaxed);
+  snapshot.framesMissed = mFramesMissed.load(std::memory_order_relaxed);
+  snapshot.serializeNanos = mSerializeNanos.load(std::memory_order_relaxed);
+  for(int i = 0; i < PusherMetricsSnapshot::sLatencyBuckets; i++) {
+    snapshot.sendLatency[i] = mSendLatency[i].load(std::memory_order_relaxed);
+  }
+  snapshot.totalDelayMicros = mTotalDelayMicros.load(std::memory_order_relaxed);
+  snapshot.extraDelayMicros = 0;
+}
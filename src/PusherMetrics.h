@@ -0,0 +1,73 @@
+/*
+ * PusherMetrics
+ *
+ * Transmit counters for one PixelPusher.  The SenderEngine worker that owns
+ * the pusher is the only writer and the render thread publishes frames, so
+ * every field is a relaxed atomic; getSnapshot() can be called from any
+ * thread at any rate without taking a lock.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+struct PusherMetricsSnapshot {
+  // bucket i counts sends that took [2^i, 2^(i+1)) microseconds; bucket 0 also takes < 1us
+  static const int sLatencyBuckets = 24;
+  PusherMetricsSnapshot();
+  void add(const PusherMetricsSnapshot& other);
+  long long getLatencyPercentileMicros(double percentile) const;
+  int pushers;
+  double packetsPerSecond;
+  double bytesPerSecond;
+  unsigned long long packetsSent;
+  unsigned long long bytesSent;
+  unsigned long long sendErrors;
+  unsigned long long framesSubmitted;
+  unsigned long long framesSent;
+  // published frames replaced before the sender picked them up
+  unsigned long long framesSkipped;
+  // group frames that went out after their window closed, or were replaced before going out
+  unsigned long long framesMissed;
+  // time spent packing and encoding strips
+  unsigned long long serializeNanos;
+  unsigned long long sendLatency[sLatencyBuckets];
+  // per-packet interval and the throttle's share of it; the largest across pushers when aggregated
+  long totalDelayMicros;
+  long extraDelayMicros;
+};
+
+class PusherMetrics {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+  PusherMetrics();
+  void recordSubmitted(bool skippedPrevious);
+  void recordFrameSent();
+  void recordFrameMissed();
+  void recordSerialize(long long nanos);
+  void recordSend(int packets, long long bytes, long long latencyMicros, bool failed, TimePoint now);
+  void setTotalDelayMicros(long totalDelayMicros);
+  void getSnapshot(PusherMetricsSnapshot& snapshot);
+ private:
+  static const long long sRateWindowMicros = 1000000;
+  std::atomic<unsigned long long> mPacketsSent;
+  std::atomic<unsigned long long> mBytesSent;
+  std::atomic<unsigned long long> mSendErrors;
+  std::atomic<unsigned long long> mFramesSubmitted;
+  std::atomic<unsigned long long> mFramesSent;
+  std::atomic<unsigned long long> mFramesSkipped;
+  std::atomic<unsigned long long> mFramesMissed;
+  std::atomic<unsigned long long> mSerializeNanos;
+  std::atomic<unsigned long long> mSendLatency[PusherMetricsSnapshot::sLatencyBuckets];
+  std::atomic<double> mPacketsPerSecond;
+  std::atomic<double> mBytesPerSecond;
+  std::atomic<long> mTotalDelayMicros;
+  // steady_clock micros of the last rate update; rates read as zero once it goes stale
+  std::atomic<long long> mRateUpdatedMicros;
+  // rate window, touched only by the sending thread
+  TimePoint mWindowStart;
+  bool mWindowStarted;
+  unsigned long long mWindowPackets;
+  unsigned long long mWindowBytes;
+};
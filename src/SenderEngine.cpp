@@ -0,0 +1,205 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "PixelPusherLog.h"
+#include "SenderEngine.h"
+#include "PixelPusher.h"
+#include <algorithm>
+
+SenderEngine* SenderEngine::mSenderEngine = NULL;
+
+SenderEngine* SenderEngine::getInstance() {
+  if(mSenderEngine == NULL) {
+    mSenderEngine = new SenderEngine();
+  }
+  return mSenderEngine;
+}
+
+void SenderEngine::freeInstance() {
+  delete mSenderEngine;
+  mSenderEngine = NULL;
+}
+
+SenderEngine::SenderEngine() {
+  //a couple of workers keep up with a full stage; they mostly sleep
+  int cores = std::thread::hardware_concurrency();
+  mWorkerCount = std::max(1, std::min(4, cores / 2));
+}
+
+SenderEngine::~SenderEngine() {
+  stopWorkers();
+}
+
+void SenderEngine::setWorkerCount(int workers) {
+  //only takes effect before the first pusher is added
+  std::lock_guard<std::mutex> lock(mWorkersMutex);
+  if(mWorkers.empty() && workers > 0) {
+    mWorkerCount = workers;
+  }
+}
+
+int SenderEngine::getWorkerCount() {
+  return mWorkerCount;
+}
+
+void SenderEngine::startWorkers() {
+  for(int i = 0; i < mWorkerCount; i++) {
+    Worker* worker = new Worker();
+    worker->running = true;
+    worker->servicing = NULL;
+    worker->servicingRemoved = false;
+    worker->servicingExpedited = false;
+    worker->maxLatenessMicros = 0;
+    mWorkers.push_back(worker);
+    worker->thread = std::thread(&SenderEngine::run, this, worker);
+  }
+  PP_LOG_NOTICE("SenderEngine started %d workers", mWorkerCount);
+}
+
+void SenderEngine::stopWorkers() {
+  std::lock_guard<std::mutex> lock(mWorkersMutex);
+  for(size_t i = 0; i < mWorkers.size(); i++) {
+    Worker* worker = mWorkers[i];
+    {
+      std::lock_guard<std::mutex> workerLock(worker->mutex);
+      worker->running = false;
+    }
+    worker->wake.notify_one();
+    if(worker->thread.joinable()) {
+      worker->thread.join();
+    }
+    //pushers still registered outlive the engine; cut them loose so their
+    //destroyCardThread() does not reach back into freed memory
+    for(size_t j = 0; j < worker->heap.size(); j++) {
+      worker->heap[j].pusher->mSenderEngine = NULL;
+    }
+    if(!worker->heap.empty()) {
+      PP_LOG_WARNING("SenderEngine stopped with %d pushers still registered", (int)worker->heap.size());
+    }
+    delete worker;
+  }
+  mWorkers.clear();
+}
+
+void SenderEngine::addPusher(PixelPusher* pusher) {
+  std::lock_guard<std::mutex> lock(mWorkersMutex);
+  if(mWorkers.empty()) {
+    startWorkers();
+  }
+  //hand the pusher to the least loaded worker
+  Worker* target = mWorkers[0];
+  for(size_t i = 1; i < mWorkers.size(); i++) {
+    std::lock_guard<std::mutex> workerLock(mWorkers[i]->mutex);
+    if(mWorkers[i]->heap.size() < target->heap.size()) {
+      target = mWorkers[i];
+    }
+  }
+  {
+    std::lock_guard<std::mutex> workerLock(target->mutex);
+    Entry entry;
+    entry.deadline = std::chrono::steady_clock::now();
+    entry.pusher = pusher;
+    target->heap.push_back(entry);
+    std::push_heap(target->heap.begin(), target->heap.end());
+  }
+  target->wake.notify_one();
+}
+
+void SenderEngine::removePusher(PixelPusher* pusher) {
+  //once this returns the pusher is never touched again: it is either taken out of a heap,
+  //or it is being serviced right now and this waits for that one call to finish
+  std::unique_lock<std::mutex> lock(mWorkersMutex);
+  for(size_t i = 0; i < mWorkers.size(); i++) {
+    Worker* worker = mWorkers[i];
+    std::unique_lock<std::mutex> workerLock(worker->mutex);
+    std::vector<Entry>& heap = worker->heap;
+    for(size_t j = 0; j < heap.size(); j++) {
+      if(heap[j].pusher == pusher) {
+        heap.erase(heap.begin() + j);
+        std::make_heap(heap.begin(), heap.end());
+        return;
+      }
+    }
+    if(worker->servicing == pusher) {
+      worker->servicingRemoved = true;
+      //workers live as long as the engine, so the engine-wide lock can go before the wait
+      lock.unlock();
+      if(std::this_thread::get_id() != worker->thread.get_id()) {
+        worker->serviced.wait(workerLock, [worker, pusher] { return worker->servicing != pusher; });
+      }
+      return;
+    }
+  }
+}
+
+void SenderEngine::expedite(PixelPusher* pusher) {
+  //pull the pusher's deadline forward to now so a submitted frame goes out at once
+  std::lock_guard<std::mutex> lock(mWorkersMutex);
+  TimePoint now = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < mWorkers.size(); i++) {
+    Worker* worker = mWorkers[i];
+    std::unique_lock<std::mutex> workerLock(worker->mutex);
+    for(size_t j = 0; j < worker->heap.size(); j++) {
+      if(worker->heap[j].pusher == pusher) {
+        worker->heap[j].deadline = now;
+        std::make_heap(worker->heap.begin(), worker->heap.end());
+        workerLock.unlock();
+        worker->wake.notify_one();
+        return;
+      }
+    }
+    if(worker->servicing == pusher) {
+      //it goes back in the heap due now once the current send is done
+      worker->servicingExpedited = true;
+      return;
+    }
+  }
+}
+
+long SenderEngine::getMaxLatenessMicros() {
+  std::lock_guard<std::mutex> lock(mWorkersMutex);
+  long lateness = 0;
+  for(size_t i = 0; i < mWorkers.size(); i++) {
+    std::lock_guard<std::mutex> workerLock(mWorkers[i]->mutex);
+    lateness = std::max(lateness, mWorkers[i]->maxLatenessMicros);
+  }
+  return lateness;
+}
+
+void SenderEngine::run(Worker* worker) {
+  std::unique_lock<std::mutex> lock(worker->mutex);
+  while(worker->running) {
+    if(worker->heap.empty()) {
+      worker->wake.wait(lock);
+      continue;
+    }
+    TimePoint now = std::chrono::steady_clock::now();
+    TimePoint deadline = worker->heap.front().deadline;
+    if(now < deadline) {
+      worker->wake.wait_until(lock, deadline);
+      continue;
+    }
+    long lateness = std::chrono::duration_cast<std::chrono::microseconds>(now - deadline).count();
+    worker->maxLatenessMicros = std::max(worker->maxLatenessMicros, lateness);
+
+    //take the pusher out and send with the mutex released, so nobody else waits on the socket
+    std::pop_heap(worker->heap.begin(), worker->heap.end());
+    Entry entry = worker->heap.back();
+    worker->heap.pop_back();
+    worker->servicing = entry.pusher;
+    worker->servicingRemoved = false;
+    worker->servicingExpedited = false;
+    lock.unlock();
+    TimePoint next = entry.pusher->service(now);
+    lock.lock();
+    worker->servicing = NULL;
+    if(worker->servicingRemoved) {
+      worker->serviced.notify_all();
+      continue;
+    }
+    entry.deadline = worker->servicingExpedited ? std::chrono::steady_clock::now() : next;
+    worker->heap.push_back(entry);
+    std::push_heap(worker->heap.begin(), worker->heap.end());
+  }
+}
@@ -0,0 +1,62 @@
+/*
+ * SenderEngine
+ *
+ * Sends pixel data for every PixelPusher from a small fixed pool of worker
+ * threads instead of one card thread per controller.  Each worker keeps a
+ * min-heap of pusher deadlines; it sleeps until the earliest deadline, lets
+ * that pusher send whatever is due through its Transport, and reschedules it.
+ * The worker's mutex is not held while a pusher sends, so adding, removing
+ * and expediting pushers never wait on the network; removePusher() only waits
+ * for the one pusher it removes to finish sending.
+ */
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+class PixelPusher;
+
+class SenderEngine {
+ public:
+  static SenderEngine* getInstance();
+  void freeInstance();
+  void setWorkerCount(int workers);
+  int getWorkerCount();
+  void addPusher(PixelPusher* pusher);
+  void removePusher(PixelPusher* pusher);
+  void expedite(PixelPusher* pusher);
+  long getMaxLatenessMicros();
+ private:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+  struct Entry {
+    TimePoint deadline;
+    PixelPusher* pusher;
+    bool operator<(const Entry& other) const { return deadline > other.deadline; }
+  };
+  struct Worker {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Entry> heap;
+    // the pusher being serviced with the mutex released, and what happened to it meanwhile
+    PixelPusher* servicing;
+    bool servicingRemoved;
+    bool servicingExpedited;
+    std::condition_variable serviced;
+    bool running;
+    long maxLatenessMicros;
+  };
+  SenderEngine();
+  ~SenderEngine();
+  void startWorkers();
+  void stopWorkers();
+  void run(Worker* worker);
+  static SenderEngine* mSenderEngine;
+  std::vector<Worker*> mWorkers;
+  std::mutex mWorkersMutex;
+  int mWorkerCount;
+};
@@ -0,0 +1,333 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "Serializer.h"
+#include <cstring>
+#include <stdint.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXELPUSHER_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define PIXELPUSHER_AVX2
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef __GNUC__
+#define PIXELPUSHER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PIXELPUSHER_TARGET_AVX2
+#endif
+
+#ifdef PIXELPUSHER_SSE2
+static void expandRGBOWSse2(const unsigned char* input, unsigned char* output, int count, unsigned int scale);
+#endif
+#ifdef PIXELPUSHER_AVX2
+static void expandRGBOWAvx2(const unsigned char* input, unsigned char* output, int count, unsigned int scale);
+#endif
+
+//constant-initialized, so selectKernel() can overwrite them during static initialization
+const char* Serializer::mKernelName = "scalar";
+Serializer::ScaleKernel Serializer::mExpandRGBOWKernel = Serializer::expandRGBOWReference;
+Serializer::ScaleKernel Serializer::mKernel = Serializer::selectKernel();
+
+unsigned int Serializer::toFixedPoint(double powerScale) {
+  if(powerScale <= 0.0) {
+    return 0;
+  }
+  if(powerScale >= 1.0) {
+    return sFixedPointOne;
+  }
+  return (unsigned int)(powerScale * sFixedPointOne + 0.5);
+}
+
+void Serializer::scaleReference(const unsigned char* input, unsigned char* output, int count, unsigned int scale) {
+  for(int i = 0; i < count; i++) {
+    output[i] = (unsigned char)applyScale(input[i], scale);
+  }
+}
+
+#ifdef PIXELPUSHER_SSE2
+static void scaleSse2(const unsigned char* input, unsigned char* output, int count, unsigned int scale) {
+  //with the byte in the high half, _mm_mulhi_epu16 gives (in * scale) >> 8; adding 0x80
+  //and dropping 8 more bits rounds exactly like the reference
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i factor = _mm_set1_epi16((short)scale);
+  const __m128i half = _mm_set1_epi16(0x80);
+  int i = 0;
+  for(; i + 16 <= count; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(input + i));
+    __m128i low = _mm_mulhi_epu16(_mm_unpacklo_epi8(zero, bytes), factor);
+    __m128i high = _mm_mulhi_epu16(_mm_unpackhi_epi8(zero, bytes), factor);
+    low = _mm_srli_epi16(_mm_add_epi16(low, half), 8);
+    high = _mm_srli_epi16(_mm_add_epi16(high, half), 8);
+    _mm_storeu_si128((__m128i*)(output + i), _mm_packus_epi16(low, high));
+  }
+  Serializer::scaleReference(input + i, output + i, count - i, scale);
+}
+#endif
+
+#ifdef PIXELPUSHER_AVX2
+PIXELPUSHER_TARGET_AVX2
+static void scaleAvx2(const unsigned char* input, unsigned char* output, int count, unsigned int scale) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i factor = _mm256_set1_epi16((short)scale);
+  const __m256i half = _mm256_set1_epi16(0x80);
+  int i = 0;
+  for(; i + 32 <= count; i += 32) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i*)(input + i));
+    //unpack/pack work per 128-bit lane, so the lane order round-trips unchanged
+    __m256i low = _mm256_mulhi_epu16(_mm256_unpacklo_epi8(zero, bytes), factor);
+    __m256i high = _mm256_mulhi_epu16(_mm256_unpackhi_epi8(zero, bytes), factor);
+    low = _mm256_srli_epi16(_mm256_add_epi16(low, half), 8);
+    high = _mm256_srli_epi16(_mm256_add_epi16(high, half), 8);
+    _mm256_storeu_si256((__m256i*)(output + i), _mm256_packus_epi16(low, high));
+  }
+  Serializer::scaleReference(input + i, output + i, count - i, scale);
+}
+
+static bool cpuHasAvx2() {
+#if defined(__GNUC__)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  int info[4];
+  __cpuid(info, 0);
+  if(info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  if(!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#endif
+}
+#endif
+
+Serializer::ScaleKernel Serializer::selectKernel() {
+#ifdef PIXELPUSHER_AVX2
+  if(cpuHasAvx2()) {
+    mKernelName = "avx2";
+    mExpandRGBOWKernel = expandRGBOWAvx2;
+    return scaleAvx2;
+  }
+#endif
+#ifdef PIXELPUSHER_SSE2
+  mKernelName = "sse2";
+  mExpandRGBOWKernel = expandRGBOWSse2;
+  return scaleSse2;
+#else
+  mKernelName = "scalar";
+  return scaleReference;
+#endif
+}
+
+void Serializer::scale(const unsigned char* input, unsigned char* output, int count, unsigned int scale) {
+  if(scale >= sFixedPointOne) {
+    memcpy(output, input, count);
+    return;
+  }
+  mKernel(input, output, count, scale);
+}
+
+const char* Serializer::getKernelName() {
+  return mKernelName;
+}
+
+void Serializer::expandRGBOWReference(const unsigned char* input, unsigned char* output, int count, unsigned int scale) {
+  for(int i = 0; i < count; i++, input += 5, output += 9) {
+    unsigned char orange = (unsigned char)applyScale(input[3], scale);
+    unsigned char white = (unsigned char)applyScale(input[4], scale);
+    output[0] = (unsigned char)applyScale(input[0], scale);
+    output[1] = (unsigned char)applyScale(input[1], scale);
+    output[2] = (unsigned char)applyScale(input[2], scale);
+    output[3] = output[4] = output[5] = orange;
+    output[6] = output[7] = output[8] = white;
+  }
+}
+
+#ifdef PIXELPUSHER_SSE2
+static void expandRGBOWSse2(const unsigned char* input, unsigned char* output, int count, unsigned int scale) {
+  //32 pixels are 160 bytes, a whole number of vectors for the byte kernel; each scaled
+  //pixel then goes out as one little-endian 8-byte word plus its last white byte
+  unsigned char scaled[160];
+  int i = 0;
+  for(; i + 32 <= count; i += 32, input += 160, output += 288) {
+    const unsigned char* pixel = input;
+    if(scale < Serializer::sFixedPointOne) {
+      Serializer::scale(input, scaled, 160, scale);
+      pixel = scaled;
+    }
+    for(int p = 0; p < 32; p++, pixel += 5) {
+      uint64_t word = pixel[0] | (pixel[1] << 8) | (pixel[2] << 16) | ((uint64_t)(pixel[3] * 0x010101u) << 24) | ((uint64_t)(pixel[4] * 0x0101u) << 48);
+      memcpy(&output[9*p], &word, 8);
+      output[9*p + 8] = pixel[4];
+    }
+  }
+  Serializer::expandRGBOWReference(input, output, count - i, scale);
+}
+#endif
+
+#ifdef PIXELPUSHER_AVX2
+PIXELPUSHER_TARGET_AVX2
+static void expandRGBOWAvx2(const unsigned char* input, unsigned char* output, int count, unsigned int scale) {
+  //three pixels are 15 bytes in and 27 out: one load, scaled in place, and two byte
+  //shuffles; the second store runs 5 bytes into the next pixels, which rewrites them
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i factor = _mm_set1_epi16((short)scale);
+  const __m128i half = _mm_set1_epi16(0x80);
+  const __m128i first = _mm_setr_epi8(0, 1, 2, 3, 3, 3, 4, 4, 4, 5, 6, 7, 8, 8, 8, 9);
+  const __m128i second = _mm_setr_epi8(9, 9, 10, 11, 12, 13, 13, 13, 14, 14, 14, -1, -1, -1, -1, -1);
+  bool scaled = scale < Serializer::sFixedPointOne;
+  int i = 0;
+  for(; i + 4 <= count; i += 3, input += 15, output += 27) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)input);
+    if(scaled) {
+      __m128i low = _mm_mulhi_epu16(_mm_unpacklo_epi8(zero, bytes), factor);
+      __m128i high = _mm_mulhi_epu16(_mm_unpackhi_epi8(zero, bytes), factor);
+      low = _mm_srli_epi16(_mm_add_epi16(low, half), 8);
+      high = _mm_srli_epi16(_mm_add_epi16(high, half), 8);
+      bytes = _mm_packus_epi16(low, high);
+    }
+    _mm_storeu_si128((__m128i*)output, _mm_shuffle_epi8(bytes, first));
+    _mm_storeu_si128((__m128i*)(output + 16), _mm_shuffle_epi8(bytes, second));
+  }
+  Serializer::expandRGBOWReference(input, output, count - i, scale);
+}
+#endif
+
+void Serializer::expandRGBOW(const unsigned char* input, unsigned char* output, int count, unsigned int scale) {
+  mExpandRGBOWKernel(input, output, count, scale);
+}
+
+void Serializer::scaleRGB16Reference(const unsigned char* input, unsigned char* output, int count, unsigned int scale) {
+  for(int i = 0; i < count; i++, input += 6, output += 6) {
+    for(int c = 0; c < 3; c++) {
+      unsigned int value = applyScale((input[c] << 8) | input[c + 3], scale);
+      output[c] = (unsigned char)(value >> 8);
+      output[c + 3] = (unsigned char)value;
+    }
+  }
+}
+
+#ifdef PIXELPUSHER_SSE2
+static void scaleRGB16Sse2(const unsigned char* input, unsigned char* output, int count, unsigned int scale) {
+  //a load at +3 lines each high byte up with its low byte, so lane k holds a channel
+  //wherever k % 6 < 3; all lanes are scaled and the masks keep the bytes that are real.
+  //Windows step by two pixels and each stores 16 bytes, the last 4 of which the next rewrites
+  const __m128i factor = _mm_set1_epi16((short)scale);
+  const __m128i lowByte = _mm_set1_epi16(0xFF);
+  const __m128i highMask = _mm_setr_epi8(-1, -1, -1, 0, 0, 0, -1, -1, -1, 0, 0, 0, -1, -1, -1, 0);
+  int i = 0;
+  for(; i + 4 <= count; i += 2, input += 12, output += 12) {
+    __m128i high = _mm_loadu_si128((const __m128i*)input);
+    __m128i low = _mm_loadu_si128((const __m128i*)(input + 3));
+    __m128i values[2] = { _mm_unpacklo_epi8(low, high), _mm_unpackhi_epi8(low, high) };
+    for(int h = 0; h < 2; h++) {
+      //(v * scale + 0x8000) >> 16 is the high half, plus one when the low half reaches 0x8000
+      __m128i rounded = _mm_srli_epi16(_mm_mullo_epi16(values[h], factor), 15);
+      values[h] = _mm_add_epi16(_mm_mulhi_epu16(values[h], factor), rounded);
+    }
+    __m128i highBytes = _mm_packus_epi16(_mm_srli_epi16(values[0], 8), _mm_srli_epi16(values[1], 8));
+    __m128i lowBytes = _mm_packus_epi16(_mm_and_si128(values[0], lowByte), _mm_and_si128(values[1], lowByte));
+    __m128i wire = _mm_or_si128(_mm_and_si128(highMask, highBytes), _mm_andnot_si128(highMask, _mm_slli_si128(lowBytes, 3)));
+    _mm_storeu_si128((__m128i*)output, wire);
+  }
+  Serializer::scaleRGB16Reference(input, output, count - i, scale);
+}
+#endif
+
+void Serializer::scaleRGB16(const unsigned char* input, unsigned char* output, int count, unsigned int scale) {
+  if(scale >= sFixedPointOne) {
+    memcpy(output, input, 6 * count);
+    return;
+  }
+#ifdef PIXELPUSHER_SSE2
+  scaleRGB16Sse2(input, output, count, scale);
+#else
+  scaleRGB16Reference(input, output, count, scale);
+#endif
+}
+
+void Serializer::convertRGBOWReference(const unsigned char* rgb, unsigned char* rgbow, int count) {
+  //white takes what all three share, orange what is left of red next to half as much green
+  for(int i = 0; i < count; i++, rgb += 3, rgbow += 5) {
+    int white = std::min(rgb[0], std::min(rgb[1], rgb[2]));
+    int red = rgb[0] - white;
+    int green = rgb[1] - white;
+    int orange = std::min(red, std::min(2 * green, 255));
+    rgbow[0] = red - orange;
+    rgbow[1] = green - (orange >> 1);
+    rgbow[2] = rgb[2] - white;
+    rgbow[3] = orange;
+    rgbow[4] = white;
+  }
+}
+
+#ifdef PIXELPUSHER_SSE2
+static void convertRGBOWSse2(const unsigned char* rgb, unsigned char* rgbow, int count) {
+  //SSE2 has no 3-byte shuffle, so four rounds of byte unpacks split 16 RGB pixels
+  //into planes; on the way out R,G,B,O are packed into one word per pixel, which
+  //leaves 32 stores instead of 80 single bytes
+  const __m128i halfMask = _mm_set1_epi8(0x7F);
+  int i = 0;
+  for(; i + 16 <= count; i += 16, rgb += 48, rgbow += 80) {
+    __m128i t00 = _mm_loadu_si128((const __m128i*)rgb);
+    __m128i t01 = _mm_loadu_si128((const __m128i*)(rgb + 16));
+    __m128i t02 = _mm_loadu_si128((const __m128i*)(rgb + 32));
+    __m128i t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+    __m128i t11 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t00, t00), t02);
+    __m128i t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+    __m128i t20 = _mm_unpacklo_epi8(t10, _mm_unpackhi_epi64(t11, t11));
+    __m128i t21 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t10, t10), t12);
+    __m128i t22 = _mm_unpacklo_epi8(t11, _mm_unpackhi_epi64(t12, t12));
+    __m128i t30 = _mm_unpacklo_epi8(t20, _mm_unpackhi_epi64(t21, t21));
+    __m128i t31 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t20, t20), t22);
+    __m128i t32 = _mm_unpacklo_epi8(t21, _mm_unpackhi_epi64(t22, t22));
+    __m128i red = _mm_unpacklo_epi8(t30, _mm_unpackhi_epi64(t31, t31));
+    __m128i green = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t30, t30), t32);
+    __m128i blue = _mm_unpacklo_epi8(t31, _mm_unpackhi_epi64(t32, t32));
+    __m128i white = _mm_min_epu8(red, _mm_min_epu8(green, blue));
+    red = _mm_sub_epi8(red, white);
+    green = _mm_sub_epi8(green, white);
+    blue = _mm_sub_epi8(blue, white);
+    __m128i orange = _mm_min_epu8(red, _mm_adds_epu8(green, green));
+    red = _mm_sub_epi8(red, orange);
+    green = _mm_sub_epi8(green, _mm_and_si128(_mm_srli_epi16(orange, 1), halfMask));
+    __m128i redGreenLow = _mm_unpacklo_epi8(red, green);
+    __m128i redGreenHigh = _mm_unpackhi_epi8(red, green);
+    __m128i blueOrangeLow = _mm_unpacklo_epi8(blue, orange);
+    __m128i blueOrangeHigh = _mm_unpackhi_epi8(blue, orange);
+    union { __m128i vector[4]; unsigned char bytes[64]; } rgbo;
+    union { __m128i vector; unsigned char bytes[16]; } whites;
+    rgbo.vector[0] = _mm_unpacklo_epi16(redGreenLow, blueOrangeLow);
+    rgbo.vector[1] = _mm_unpackhi_epi16(redGreenLow, blueOrangeLow);
+    rgbo.vector[2] = _mm_unpacklo_epi16(redGreenHigh, blueOrangeHigh);
+    rgbo.vector[3] = _mm_unpackhi_epi16(redGreenHigh, blueOrangeHigh);
+    whites.vector = white;
+    for(int p = 0; p < 16; p++) {
+      memcpy(&rgbow[5*p], &rgbo.bytes[4*p], 4);
+      rgbow[5*p + 4] = whites.bytes[p];
+    }
+  }
+  Serializer::convertRGBOWReference(rgb, rgbow, count - i);
+}
+#endif
+
+void Serializer::convertRGBOW(const unsigned char* rgb, unsigned char* rgbow, int count) {
+#ifdef PIXELPUSHER_SSE2
+  convertRGBOWSse2(rgb, rgbow, count);
+#else
+  convertRGBOWReference(rgb, rgbow, count);
+#endif
+}
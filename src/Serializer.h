@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * Serializer
+ *
+ * Byte kernels used by Strip::serialize().  The power scale is applied in
+ * 16.16 fixed point, rounded to nearest: out = (in * scale + 0x8000) >> 16,
+ * so every implementation (scalar, SSE2, AVX2) produces the same bytes.  The fastest one supported
+ * by the running CPU is picked once at static initialization.
+ *
+ * RGBOW strips go out as R,G,B,O,O,O,W,W,W: each pixel fills three wire
+ * pixels.  convertRGBOW() derives orange and white from RGB content; the
+ * SSE2 version does the colour math on 16 pixels at a time with no
+ * per-pixel branches and matches the reference byte for byte.  Expanding
+ * RGBOW to the wire uses byte shuffles where AVX2 (and so SSSE3) is there,
+ * and scaling 16-bit pixels splits them into lanes with SSE2; both match
+ * their references too.
+ */
+
+class Serializer {
+ public:
+  typedef void (*ScaleKernel)(const unsigned char* input, unsigned char* output, int count, unsigned int scale);
+  static const unsigned int sFixedPointOne = 65536;
+  static unsigned int toFixedPoint(double powerScale);
+  // one value, 8 or 16 bits, times a 16.16 scale of at most 1.0; the sum stays within 32 bits
+  static unsigned int applyScale(unsigned int value, unsigned int scale) {
+    return (value * scale + 0x8000) >> 16;
+  }
+  static void scale(const unsigned char* input, unsigned char* output, int count, unsigned int scale);
+  static void scaleReference(const unsigned char* input, unsigned char* output, int count, unsigned int scale);
+  static const char* getKernelName();
+  // count 5-byte RGBOW pixels to 9 wire bytes each
+  static void expandRGBOW(const unsigned char* input, unsigned char* output, int count, unsigned int scale);
+  static void expandRGBOWReference(const unsigned char* input, unsigned char* output, int count, unsigned int scale);
+  // count 6-byte pixels of 16-bit R,G,B, high bytes first then low bytes
+  static void scaleRGB16(const unsigned char* input, unsigned char* output, int count, unsigned int scale);
+  static void scaleRGB16Reference(const unsigned char* input, unsigned char* output, int count, unsigned int scale);
+  // count 3-byte RGB pixels to 5-byte RGBOW pixels
+  static void convertRGBOW(const unsigned char* rgb, unsigned char* rgbow, int count);
+  static void convertRGBOWReference(const unsigned char* rgb, unsigned char* rgbow, int count);
+ private:
+  static ScaleKernel selectKernel();
+  static ScaleKernel mKernel;
+  static ScaleKernel mExpandRGBOWKernel;
+  static const char* mKernelName;
+};
@@ -0,0 +1,170 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "SharedFrameIngest.h"
+#include "DiscoveryListener.h"
+#include "PixelPusherLog.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+static bool macLess(const std::shared_ptr<PixelPusher>& pusher, uint64_t macKey) {
+  return pusher->getMacKey() < macKey;
+}
+
+SharedFrameIngest::SharedFrameIngest() {
+  mGeneration = 0;
+  mResolved = false;
+  mLastSequence = 0;
+  mRunning = false;
+  mFramesReceived = 0;
+  mDroppedFrames = 0;
+  mTornFrames = 0;
+  mUnmatchedStrips = 0;
+}
+
+SharedFrameIngest::~SharedFrameIngest() {
+  stop();
+  detach();
+}
+
+bool SharedFrameIngest::attach(const std::string& name) {
+  detach();
+  if(!mRing.attach(name)) {
+    return false;
+  }
+  mStaging.assign(mRing.getFrameBytes(), 0);
+  //frames already in the ring are history; start from the newest one
+  mLastSequence = mRing.getWriteSequence();
+  if(mLastSequence > 0) {
+    mLastSequence--;
+  }
+  PP_LOG_NOTICE("SharedFrameIngest attached to %s: %d strips, %d slots", name.c_str(), mRing.getStripCount(), mRing.getSlotCount());
+  return true;
+}
+
+void SharedFrameIngest::detach() {
+  mRing.close();
+  mTargets.clear();
+  mResolved = false;
+}
+
+void SharedFrameIngest::resolve(const RegistrySnapshot& snapshot) {
+  //once per registry generation; the layout itself never changes
+  int unmatched = 0;
+  mTargets.assign(mRing.getStripCount(), Target());
+  for(int i = 0; i < mRing.getStripCount(); i++) {
+    const SharedRingStrip& layout = mRing.getStrip(i);
+    std::vector<std::shared_ptr<PixelPusher> >::const_iterator found = std::lower_bound(snapshot.pushers.begin(), snapshot.pushers.end(), layout.macKey, macLess);
+    if(found == snapshot.pushers.end() || (*found)->getMacKey() != layout.macKey || layout.stripNumber >= (*found)->getNumberOfStrips()) {
+      unmatched++;
+      continue;
+    }
+    std::shared_ptr<Strip> strip = (*found)->getStrip(layout.stripNumber);
+    if(strip->getChannels() != layout.channels || strip->getLength() != (int)layout.pixels) {
+      unmatched++;
+      continue;
+    }
+    mTargets[i].pusher = *found;
+    mTargets[i].strip = strip;
+  }
+  mUnmatchedStrips = unmatched;
+  mGeneration = snapshot.generation;
+  mResolved = true;
+}
+
+bool SharedFrameIngest::poll(const RegistrySnapshot& snapshot) {
+  if(!mRing.isOpen()) {
+    return false;
+  }
+  uint64_t sequence = mRing.getWriteSequence();
+  if(sequence == mLastSequence) {
+    return false;
+  }
+  if(!mResolved || snapshot.generation != mGeneration) {
+    resolve(snapshot);
+  }
+  const unsigned char* frame = mRing.beginRead(sequence);
+  if(frame == NULL) {
+    //already being overwritten; the next poll finds a newer one
+    tearFrame(sequence);
+    return false;
+  }
+  //stage first: the strips only see the frame once endRead() vouches for it
+  for(size_t i = 0; i < mTargets.size(); i++) {
+    if(mTargets[i].strip) {
+      const SharedRingStrip& layout = mRing.getStrip(i);
+      memcpy(&mStaging[layout.offset], frame + layout.offset, (size_t)layout.pixels * layout.channels);
+    }
+  }
+  if(!mRing.endRead(sequence)) {
+    //the producer lapped us mid-copy
+    tearFrame(sequence);
+    return false;
+  }
+  mPushers.clear();
+  for(size_t i = 0; i < mTargets.size(); i++) {
+    const Target& target = mTargets[i];
+    if(!target.strip) {
+      continue;
+    }
+    PixelView view = target.strip->getPixelView();
+    memcpy(view.data, &mStaging[mRing.getStrip(i).offset], view.size());
+    target.strip->markTouched();
+    if(std::find(mPushers.begin(), mPushers.end(), target.pusher.get()) == mPushers.end()) {
+      mPushers.push_back(target.pusher.get());
+    }
+  }
+  for(size_t i = 0; i < mPushers.size(); i++) {
+    mPushers[i]->publish();
+  }
+  mDroppedFrames += sequence - mLastSequence - 1;
+  mFramesReceived++;
+  mLastSequence = sequence;
+  mRing.setReadSequence(sequence);
+  return true;
+}
+
+void SharedFrameIngest::tearFrame(uint64_t sequence) {
+  //counted as torn only; the frames skipped before it still count as dropped
+  mTornFrames++;
+  mDroppedFrames += sequence - mLastSequence - 1;
+  mLastSequence = sequence;
+}
+
+void SharedFrameIngest::start(DiscoveryListener* listener, long pollMicros) {
+  stop();
+  mRunning = true;
+  mThread = std::thread(&SharedFrameIngest::run, this, listener, pollMicros);
+}
+
+void SharedFrameIngest::stop() {
+  mRunning = false;
+  if(mThread.joinable()) {
+    mThread.join();
+  }
+}
+
+void SharedFrameIngest::run(DiscoveryListener* listener, long pollMicros) {
+  while(mRunning) {
+    poll(*listener->getSnapshot());
+    std::this_thread::sleep_for(std::chrono::microseconds(pollMicros));
+  }
+}
+
+unsigned long long SharedFrameIngest::getFramesReceived() {
+  return mFramesReceived;
+}
+
+unsigned long long SharedFrameIngest::getDroppedFrames() {
+  return mDroppedFrames;
+}
+
+unsigned long long SharedFrameIngest::getTornFrames() {
+  return mTornFrames;
+}
+
+int SharedFrameIngest::getUnmatchedStrips() {
+  return mUnmatchedStrips;
+}
@@ -0,0 +1,73 @@
+/*
+ * SharedFrameIngest
+ *
+ * Feeds the registry from a SharedFrameRing written by another process.
+ * Each poll() takes the newest complete frame, copies it out of the ring,
+ * and once the copy is known to be intact moves every strip of the layout
+ * into the matching Strip's write buffer and publishes the pushers it
+ * touched, so the renderer's bytes reach the sender without going through
+ * setPixel().  Frames the producer published in between are counted as
+ * dropped, and a frame overwritten while it was copied is thrown away and
+ * counted as torn.  poll() can be driven by the app or by start(), which
+ * runs it on a thread of its own.
+ *
+ * Publishing is single-writer per PixelPusher, so while ingest is running it
+ * must be the only thing writing or publishing the pushers in its layout.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <stdint.h>
+#include "SharedFrameRing.h"
+
+struct RegistrySnapshot;
+class DiscoveryListener;
+class PixelPusher;
+class Strip;
+
+class SharedFrameIngest {
+ public:
+  SharedFrameIngest();
+  ~SharedFrameIngest();
+  bool attach(const std::string& name);
+  void detach();
+  // true if a new frame went to the strips
+  bool poll(const RegistrySnapshot& snapshot);
+  // polls the listener's current snapshot every pollMicros until stop()
+  void start(DiscoveryListener* listener, long pollMicros);
+  void stop();
+  unsigned long long getFramesReceived();
+  // published frames the consumer never got to
+  unsigned long long getDroppedFrames();
+  unsigned long long getTornFrames();
+  // layout strips with no registered pusher or strip, or a size that does not match
+  int getUnmatchedStrips();
+ private:
+  struct Target {
+    std::shared_ptr<PixelPusher> pusher;
+    std::shared_ptr<Strip> strip;
+  };
+  void resolve(const RegistrySnapshot& snapshot);
+  void tearFrame(uint64_t sequence);
+  void run(DiscoveryListener* listener, long pollMicros);
+  SharedFrameRing mRing;
+  // parallel to the ring's layout, valid for mGeneration
+  std::vector<Target> mTargets;
+  std::vector<PixelPusher*> mPushers;
+  // the frame as copied out of the ring, laid out like a slot
+  std::vector<unsigned char> mStaging;
+  unsigned long mGeneration;
+  bool mResolved;
+  uint64_t mLastSequence;
+  std::thread mThread;
+  std::atomic<bool> mRunning;
+  std::atomic<unsigned long long> mFramesReceived;
+  std::atomic<unsigned long long> mDroppedFrames;
+  std::atomic<unsigned long long> mTornFrames;
+  std::atomic<int> mUnmatchedStrips;
+};
@@ -0,0 +1,247 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "SharedFrameRing.h"
+#include "PixelPusherLog.h"
+#include <chrono>
+#include <cstring>
+
+#ifndef TARGET_WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(SharedRingStrip) == 24, "SharedRingStrip must stay 24 bytes");
+static_assert(sizeof(std::atomic<uint64_t>) == 8, "shared sequence numbers must be plain 64-bit words");
+
+const char SharedFrameRing::sMagic[8] = { 'P', 'P', 'S', 'H', 'R', 'I', 'N', 'G' };
+
+//everything in the segment starts on its own cache line
+static const size_t sLineBytes = 64;
+static_assert(sizeof(SharedRingHeader) <= sLineBytes, "SharedRingHeader must fit one cache line");
+static_assert(sizeof(SharedRingSlot) <= sLineBytes, "SharedRingSlot must fit one cache line");
+
+static size_t alignLine(size_t bytes) {
+  return (bytes + sLineBytes - 1) & ~(sLineBytes - 1);
+}
+
+static size_t getSlotsOffset(uint32_t stripCount) {
+  return sLineBytes + alignLine(stripCount * sizeof(SharedRingStrip));
+}
+
+static uint64_t getMagicWord() {
+  uint64_t word;
+  memcpy(&word, SharedFrameRing::sMagic, sizeof(word));
+  return word;
+}
+
+SharedFrameRing::SharedFrameRing() {
+  mBase = NULL;
+  mSize = 0;
+  mOwner = false;
+  mHeader = NULL;
+  mStrips = NULL;
+  mWriting = 0;
+}
+
+SharedFrameRing::~SharedFrameRing() {
+  close();
+}
+
+#ifdef TARGET_WIN32
+
+bool SharedFrameRing::create(const std::string& name, const std::vector<SharedRingStrip>& strips, int slots) {
+  PP_LOG_ERROR("SharedFrameRing needs POSIX shared memory");
+  return false;
+}
+
+bool SharedFrameRing::attach(const std::string& name) {
+  PP_LOG_ERROR("SharedFrameRing needs POSIX shared memory");
+  return false;
+}
+
+void SharedFrameRing::close() {
+}
+
+#else
+
+bool SharedFrameRing::create(const std::string& name, const std::vector<SharedRingStrip>& strips, int slots) {
+  close();
+  if(slots < 2) {
+    PP_LOG_ERROR("SharedFrameRing needs at least two slots");
+    return false;
+  }
+  std::vector<SharedRingStrip> layout(strips);
+  uint64_t frameBytes = 0;
+  for(size_t i = 0; i < layout.size(); i++) {
+    layout[i].offset = frameBytes;
+    frameBytes += alignLine((size_t)layout[i].pixels * layout[i].channels);
+  }
+  uint64_t slotStride = sLineBytes + frameBytes;
+  size_t size = getSlotsOffset(layout.size()) + slots * slotStride;
+
+  //a stale segment of the same name may have another layout
+  shm_unlink(name.c_str());
+  int descriptor = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if(descriptor < 0 || ftruncate(descriptor, size) != 0) {
+    PP_LOG_ERROR("SharedFrameRing could not create %s", name.c_str());
+    if(descriptor >= 0) {
+      ::close(descriptor);
+      shm_unlink(name.c_str());
+    }
+    return false;
+  }
+  mName = name;
+  if(!map(descriptor, size, true)) {
+    return false;
+  }
+
+  //the segment starts zeroed, so every slot reads as never written
+  mHeader->version = SharedRingHeader::sVersion;
+  mHeader->slotCount = slots;
+  mHeader->stripCount = layout.size();
+  mHeader->frameBytes = frameBytes;
+  mHeader->slotStride = slotStride;
+  mHeader->writeSequence.store(0, std::memory_order_relaxed);
+  mHeader->readSequence.store(0, std::memory_order_relaxed);
+  if(!layout.empty()) {
+    memcpy(mBase + sLineBytes, &layout[0], layout.size() * sizeof(SharedRingStrip));
+  }
+  //the magic goes in last; a consumer attaching early sees no ring yet
+  mHeader->magic.store(getMagicWord(), std::memory_order_release);
+  return true;
+}
+
+bool SharedFrameRing::attach(const std::string& name) {
+  close();
+  int descriptor = shm_open(name.c_str(), O_RDWR, 0);
+  struct stat info;
+  if(descriptor < 0 || fstat(descriptor, &info) != 0 || (size_t)info.st_size < sLineBytes) {
+    PP_LOG_ERROR("SharedFrameRing could not attach to %s", name.c_str());
+    if(descriptor >= 0) {
+      ::close(descriptor);
+    }
+    return false;
+  }
+  mName = name;
+  if(!map(descriptor, info.st_size, false)) {
+    return false;
+  }
+  //pairs with the release store in create(), so the layout read below is complete
+  if(mHeader->magic.load(std::memory_order_acquire) != getMagicWord() || mHeader->version != SharedRingHeader::sVersion ||
+     mHeader->slotCount < 2 || getSlotsOffset(mHeader->stripCount) + mHeader->slotCount * mHeader->slotStride > mSize) {
+    PP_LOG_ERROR("SharedFrameRing: %s is not a frame ring this build can read", name.c_str());
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool SharedFrameRing::map(int descriptor, size_t size, bool owner) {
+  void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+  ::close(descriptor);
+  if(base == MAP_FAILED) {
+    PP_LOG_ERROR("SharedFrameRing could not map %s", mName.c_str());
+    if(owner) {
+      shm_unlink(mName.c_str());
+    }
+    return false;
+  }
+  mBase = static_cast<unsigned char*>(base);
+  mSize = size;
+  mOwner = owner;
+  mHeader = reinterpret_cast<SharedRingHeader*>(mBase);
+  mStrips = reinterpret_cast<const SharedRingStrip*>(mBase + sLineBytes);
+  return true;
+}
+
+void SharedFrameRing::close() {
+  if(mBase != NULL) {
+    munmap(mBase, mSize);
+    if(mOwner) {
+      shm_unlink(mName.c_str());
+    }
+  }
+  mBase = NULL;
+  mSize = 0;
+  mOwner = false;
+  mHeader = NULL;
+  mStrips = NULL;
+  mWriting = 0;
+}
+
+#endif
+
+bool SharedFrameRing::isOpen() {
+  return mBase != NULL;
+}
+
+int SharedFrameRing::getStripCount() {
+  return mHeader != NULL ? mHeader->stripCount : 0;
+}
+
+const SharedRingStrip& SharedFrameRing::getStrip(int index) {
+  return mStrips[index];
+}
+
+int SharedFrameRing::getSlotCount() {
+  return mHeader != NULL ? mHeader->slotCount : 0;
+}
+
+size_t SharedFrameRing::getFrameBytes() {
+  return mHeader != NULL ? (size_t)mHeader->frameBytes : 0;
+}
+
+SharedRingSlot* SharedFrameRing::getSlot(uint64_t sequence) {
+  size_t slot = (sequence - 1) % mHeader->slotCount;
+  return reinterpret_cast<SharedRingSlot*>(mBase + getSlotsOffset(mHeader->stripCount) + slot * mHeader->slotStride);
+}
+
+void SharedFrameRing::beginFrame() {
+  mWriting = mHeader->writeSequence.load(std::memory_order_relaxed) + 1;
+  getSlot(mWriting)->sequence.store(2 * mWriting - 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+unsigned char* SharedFrameRing::getStripData(int index) {
+  return reinterpret_cast<unsigned char*>(getSlot(mWriting)) + sLineBytes + mStrips[index].offset;
+}
+
+void SharedFrameRing::publishFrame() {
+  SharedRingSlot* slot = getSlot(mWriting);
+  slot->timeMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  slot->sequence.store(2 * mWriting, std::memory_order_release);
+  mHeader->writeSequence.store(mWriting, std::memory_order_release);
+}
+
+uint64_t SharedFrameRing::getConsumerLag() {
+  return mHeader->writeSequence.load(std::memory_order_relaxed) - mHeader->readSequence.load(std::memory_order_relaxed);
+}
+
+uint64_t SharedFrameRing::getWriteSequence() {
+  return mHeader->writeSequence.load(std::memory_order_acquire);
+}
+
+const unsigned char* SharedFrameRing::beginRead(uint64_t sequence) {
+  if(sequence == 0) {
+    return NULL;
+  }
+  SharedRingSlot* slot = getSlot(sequence);
+  if(slot->sequence.load(std::memory_order_acquire) != 2 * sequence) {
+    return NULL;
+  }
+  return reinterpret_cast<const unsigned char*>(slot) + sLineBytes;
+}
+
+bool SharedFrameRing::endRead(uint64_t sequence) {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return getSlot(sequence)->sequence.load(std::memory_order_relaxed) == 2 * sequence;
+}
+
+void SharedFrameRing::setReadSequence(uint64_t sequence) {
+  mHeader->readSequence.store(sequence, std::memory_order_relaxed);
+}
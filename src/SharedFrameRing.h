@@ -0,0 +1,97 @@
+/*
+ * SharedFrameRing
+ *
+ * A frame ring in POSIX shared memory for handing pixels from a renderer
+ * process to the sender without linking the addon or taking a lock.  The
+ * renderer creates the segment with a layout (which controller MAC and strip
+ * each block of bytes belongs to), then fills and publishes one slot per
+ * frame; SharedFrameIngest attaches by name on the sending side.  There is
+ * one producer, and each slot carries a sequence number written before and
+ * after the pixels, like TraceBuffer, so the consumer can spot a slot that
+ * was overwritten while it read.  A renderer only needs SharedFrameRing.h and
+ * SharedFrameRing.cpp (built with PIXELPUSHER_HEADLESS).  POSIX only.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// one strip of the layout; pixel bytes sit at offset within every slot
+struct SharedRingStrip {
+  uint64_t macKey;
+  uint16_t stripNumber;
+  // bytes per pixel, as Strip::getChannels()
+  uint16_t channels;
+  uint32_t pixels;
+  uint64_t offset;
+};
+
+struct SharedRingHeader {
+  static const uint32_t sVersion = 1;
+  // SharedFrameRing::sMagic as a word, stored last with release so an attach that sees it sees the whole layout
+  std::atomic<uint64_t> magic;
+  uint32_t version;
+  uint32_t slotCount;
+  uint32_t stripCount;
+  uint32_t reserved;
+  // pixel bytes per frame, and the distance between slots including their SharedRingSlot
+  uint64_t frameBytes;
+  uint64_t slotStride;
+  // frames published so far; frame n lives in slot (n - 1) % slotCount
+  std::atomic<uint64_t> writeSequence;
+  // last frame the consumer took, so the producer can see it falling behind
+  std::atomic<uint64_t> readSequence;
+};
+
+struct SharedRingSlot {
+  // 2n - 1 while frame n is being written, 2n once it is complete
+  std::atomic<uint64_t> sequence;
+  int64_t timeMicros;
+};
+
+class SharedFrameRing {
+ public:
+  static const char sMagic[8];
+  SharedFrameRing();
+  ~SharedFrameRing();
+  // producer: creates or replaces the segment; strip offsets are filled in here
+  bool create(const std::string& name, const std::vector<SharedRingStrip>& strips, int slots);
+  // consumer: maps a segment created by another process
+  bool attach(const std::string& name);
+  // unmaps; the creator also removes the name
+  void close();
+  bool isOpen();
+  int getStripCount();
+  const SharedRingStrip& getStrip(int index);
+  int getSlotCount();
+  // pixel bytes of one frame, strip offsets included
+  size_t getFrameBytes();
+
+  // producer side: fill the strips of the frame begun, then publish it
+  void beginFrame();
+  unsigned char* getStripData(int index);
+  void publishFrame();
+  // frames published but never taken, as the consumer last reported
+  uint64_t getConsumerLag();
+
+  // consumer side: the newest frame is read between these two; endRead()
+  // says false if the producer overwrote it meanwhile
+  uint64_t getWriteSequence();
+  const unsigned char* beginRead(uint64_t sequence);
+  bool endRead(uint64_t sequence);
+  void setReadSequence(uint64_t sequence);
+ private:
+  bool map(int descriptor, size_t size, bool owner);
+  SharedRingSlot* getSlot(uint64_t sequence);
+  std::string mName;
+  unsigned char* mBase;
+  size_t mSize;
+  bool mOwner;
+  SharedRingHeader* mHeader;
+  const SharedRingStrip* mStrips;
+  // producer: the frame being written
+  uint64_t mWriting;
+};
@@ -3,93 +3,359 @@
 #endif
 
 #include "Strip.h"
+#include "PixelPusherLog.h"
+#include <algorithm>
 
-Strip::Strip(short stripNumber, int length) {
-  for(int i = 0; i < length; i++) {
-      mPixels.push_back(std::shared_ptr<Pixel>(new Pixel()));
+Strip::Strip(short stripNumber, int length, PixelFormat format) {
+  //length counts the controller's pixels; the payload stays 3 bytes per wire
+  //pixel, so wider formats get fewer pixels of their own
+  mFormat = &getPixelFormatSpec(format);
+  mWirePixels = length;
+  mLength = 3 * length / mFormat->wireBytes;
+  mChannels = mFormat->channels;
+  int blocks = (mLength + sDirtyBlockPixels - 1) / sDirtyBlockPixels;
+  for(int i = 0; i < 3; i++) {
+    mPixels[i].assign(mLength * mChannels, 0);
+    mDirtyBlocks[i].assign((blocks + 63) / 64, 0);
   }
+  mDirty.assign((blocks + 63) / 64, 0);
+  mEncodedBytes = 0;
+  mTotalEncodedBytes = 0;
+  mTripleBuffer = std::make_shared<TripleBuffer>();
   mStripNumber = stripNumber;
+  mStripNumberData[0] = (stripNumber >> 8) & 0xFF;
+  mStripNumberData[1] = stripNumber & 0xFF;
   mTouched = false;
-  mIsRGBOW = false;
-  mPixelData.reserve(3*length);
-  for(int i = 0; i < 3*length; i++) {
-    mPixelData[i] = 0;
-  }
+  mUseAntiLog = true;
+  //wire pixels past the last whole pixel stay dark
+  mPixelData.assign(3*length, 0);
   mPowerScale = 1.0;
+  mPowerScaleFixed = Serializer::sFixedPointOne;
 }
 
 Strip::~Strip() {
 }
 
 bool Strip::isRGBOW() {
-  return mIsRGBOW;
+  return mFormat->format == PIXEL_RGBOW;
 }
 
 void Strip::setRGBOW(bool rgbow) {
-  //to implement -- not sure how exactly the conversion works
+  //the sender may be reading this strip, so its layout cannot change any more
+  if(rgbow != isRGBOW()) {
+    PP_LOG_WARNING("Strip %d is %s; its format is fixed when the PixelPusher creates it", mStripNumber, mFormat->name);
+  }
+}
+
+PixelFormat Strip::getPixelFormat() {
+  return mFormat->format;
+}
+
+void Strip::storeRGB(unsigned char* pixel, unsigned char r, unsigned char g, unsigned char b) {
+  pixel[0] = r;
+  pixel[1] = g;
+  pixel[2] = b;
+  if(mFormat->format == PIXEL_RGB16) {
+    //v * 257 spans the full 16-bit range
+    pixel[3] = r;
+    pixel[4] = g;
+    pixel[5] = b;
+  }
+}
+
+void Strip::storeOW(unsigned char* pixel, unsigned char o, unsigned char w) {
+  if(mFormat->format == PIXEL_RGBOW) {
+    pixel[3] = o;
+    pixel[4] = w;
+  }
+  else if(mFormat->format == PIXEL_RGBW) {
+    pixel[3] = w;
+  }
 }
 
 int Strip::getLength() {
-  return mPixels.size();
+  return mLength;
 }
 
 bool Strip::isTouched() {
   return mTouched;
 }
 
+void Strip::markTouched() {
+  markDirty(mTripleBuffer->getWriteIndex(), 0, mLength);
+}
+
+void Strip::markTouched(int position, int count) {
+  int begin = std::max(position, 0);
+  int end = std::min(position + count, mLength);
+  if(begin < end) {
+    markDirty(mTripleBuffer->getWriteIndex(), begin, end);
+  }
+}
+
+void Strip::markDirty(int slot, int begin, int end) {
+  if(begin >= end) {
+    return;
+  }
+  uint64_t* dirty = mDirtyBlocks[slot].data();
+  int last = (end - 1) / sDirtyBlockPixels;
+  for(int block = begin / sDirtyBlockPixels; block <= last; block++) {
+    dirty[block >> 6] |= (uint64_t)1 << (block & 63);
+  }
+}
+
 short Strip::getStripNumber() {
   return mStripNumber;
 }
 
+void Strip::setAntiLog(bool useAntiLog) {
+  mUseAntiLog = useAntiLog;
+}
+
+bool Strip::getAntiLog() {
+  return mUseAntiLog;
+}
+
 void Strip::setPixels(unsigned char r, unsigned char g, unsigned char b) {
-  for(int i = 0; i < mPixels.size(); i++) {
-    mPixels[i]->setColor(r, g, b);
+  if(mUseAntiLog) {
+    r = Pixel::mLinearExp[r];
+    g = Pixel::mLinearExp[g];
+    b = Pixel::mLinearExp[b];
+  }
+  int slot = mTripleBuffer->getWriteIndex();
+  unsigned char* pixel = mPixels[slot].data();
+  for(int i = 0; i < mLength; i++, pixel += mChannels) {
+    storeRGB(pixel, r, g, b);
+  }
+  markDirty(slot, 0, mLength);
+}
+
+void Strip::setPixels(unsigned char r, unsigned char g, unsigned char b, unsigned char o, unsigned char w) {
+  setPixels(r, g, b);
+  if(mUseAntiLog) {
+    o = Pixel::mLinearExp[o];
+    w = Pixel::mLinearExp[w];
+  }
+  unsigned char* pixel = mPixels[mTripleBuffer->getWriteIndex()].data();
+  for(int i = 0; i < mLength; i++, pixel += mChannels) {
+    storeOW(pixel, o, w);
   }
-  mTouched = true;
 }
 
 void Strip::setPixels(std::vector<std::shared_ptr<Pixel> > pixels) {
-  mPixels = pixels;
-  mTouched = true;
+  int count = std::min<int>(pixels.size(), mLength);
+  for(int i = 0; i < count; i++) {
+    setPixel(i, pixels[i]);
+  }
+  markTouched();
 }
 
 void Strip::setPixel(int position, unsigned char r, unsigned char g, unsigned char b) {
-  mPixels[position]->setColor(r,g,b);
-  mTouched = true;
+  if(position < 0 || position >= mLength) {
+    return;
+  }
+  int slot = mTripleBuffer->getWriteIndex();
+  unsigned char* pixel = &mPixels[slot][position * mChannels];
+  if(mUseAntiLog) {
+    storeRGB(pixel, Pixel::mLinearExp[r], Pixel::mLinearExp[g], Pixel::mLinearExp[b]);
+  }
+  else {
+    storeRGB(pixel, r, g, b);
+  }
+  int block = position / sDirtyBlockPixels;
+  mDirtyBlocks[slot][block >> 6] |= (uint64_t)1 << (block & 63);
+}
+
+void Strip::setPixel(int position, unsigned char r, unsigned char g, unsigned char b, unsigned char o, unsigned char w) {
+  setPixel(position, r, g, b);
+  if(position < 0 || position >= mLength) {
+    return;
+  }
+  unsigned char* pixel = &mPixels[mTripleBuffer->getWriteIndex()][position * mChannels];
+  if(mUseAntiLog) {
+    storeOW(pixel, Pixel::mLinearExp[o], Pixel::mLinearExp[w]);
+  }
+  else {
+    storeOW(pixel, o, w);
+  }
+}
+
+void Strip::setRGBPixels(int position, const unsigned char* rgb, int count) {
+  int begin = std::max(position, 0);
+  int end = std::min(position + count, mLength);
+  if(begin >= end) {
+    return;
+  }
+  rgb += 3 * (begin - position);
+  int slot = mTripleBuffer->getWriteIndex();
+  unsigned char* pixel = &mPixels[slot][begin * mChannels];
+  if(mFormat->format == PIXEL_RGBOW) {
+    Serializer::convertRGBOW(rgb, pixel, end - begin);
+  }
+  else if(mChannels == 3) {
+    std::copy(rgb, rgb + 3 * (end - begin), pixel);
+  }
+  else {
+    for(int i = begin; i < end; i++, rgb += 3, pixel += mChannels) {
+      storeRGB(pixel, rgb[0], rgb[1], rgb[2]);
+    }
+  }
+  markDirty(slot, begin, end);
+}
+
+void Strip::storeRGBPixel(unsigned char* pixel, const unsigned char* rgb) {
+  if(mFormat->format == PIXEL_RGBOW) {
+    Serializer::convertRGBOW(rgb, pixel, 1);
+  }
+  else {
+    storeRGB(pixel, rgb[0], rgb[1], rgb[2]);
+  }
 }
 
 void Strip::setPixel(int position, std::shared_ptr<Pixel> pixel) {
-  mPixels[position] = pixel;
-  mTouched = true;
+  //the Pixel already holds output values, so they are copied in as-is
+  if(!pixel || position < 0 || position >= mLength) {
+    return;
+  }
+  int slot = mTripleBuffer->getWriteIndex();
+  unsigned char* destination = &mPixels[slot][position * mChannels];
+  storeRGB(destination, pixel->mRed, pixel->mGreen, pixel->mBlue);
+  storeOW(destination, pixel->mOrange, pixel->mWhite);
+  markDirty(slot, position, position + 1);
 }
 
 std::vector<std::shared_ptr<Pixel> > Strip::getPixels() {
-  return mPixels;
+  //compatibility only: builds detached copies of the packed buffer
+  std::vector<std::shared_ptr<Pixel> > pixels;
+  pixels.reserve(mLength);
+  for(int i = 0; i < mLength; i++) {
+    const unsigned char* source = &mPixels[mTripleBuffer->getWriteIndex()][i * mChannels];
+    if(mFormat->format == PIXEL_RGBOW) {
+      pixels.push_back(std::make_shared<Pixel>(source[0], source[1], source[2], source[3], source[4]));
+    }
+    else if(mFormat->format == PIXEL_RGBW) {
+      pixels.push_back(std::make_shared<Pixel>(source[0], source[1], source[2], 0, source[3]));
+    }
+    else {
+      pixels.push_back(std::make_shared<Pixel>(source[0], source[1], source[2]));
+    }
+  }
+  return pixels;
+}
+
+PixelView Strip::getPixelView() {
+  PixelView view;
+  view.data = mPixels[mTripleBuffer->getWriteIndex()].data();
+  view.length = mLength;
+  view.channels = mChannels;
+  return view;
 }
 
 int Strip::getNumPixels() {
-  return mPixels.size();
+  return mLength;
+}
+
+int Strip::getChannels() {
+  return mChannels;
 }
 
 void Strip::setPowerScale(double powerscale) {
   mPowerScale = powerscale;
+  mPowerScaleFixed = Serializer::toFixedPoint(powerscale);
+  //every encoded byte depends on the scale
+  markTouched();
+}
+
+void Strip::setTripleBuffer(std::shared_ptr<TripleBuffer> tripleBuffer) {
+  //bring the pending writes along into the new writer slot
+  int from = mTripleBuffer->getWriteIndex();
+  int to = tripleBuffer->getWriteIndex();
+  if(from != to) {
+    mPixels[to] = mPixels[from];
+  }
+  mDirtyBlocks[to] = mDirtyBlocks[from];
+  mTripleBuffer = tripleBuffer;
+  markTouched();
+}
+
+std::shared_ptr<TripleBuffer> Strip::getTripleBuffer() {
+  return mTripleBuffer;
+}
+
+void Strip::carryOver(int pendingIndex) {
+  //app thread, before publish(): a frame the card thread never picked up
+  //still has to be sent, so its touched flag rides along with the next one
+  std::vector<uint64_t>& dirty = mDirtyBlocks[mTripleBuffer->getWriteIndex()];
+  const std::vector<uint64_t>& pending = mDirtyBlocks[pendingIndex];
+  for(size_t i = 0; i < dirty.size(); i++) {
+    dirty[i] |= pending[i];
+  }
+}
+
+void Strip::commit(int publishedIndex) {
+  //app thread, after publish(): start the new writer slot from the frame just published
+  int slot = mTripleBuffer->getWriteIndex();
+  mPixels[slot] = mPixels[publishedIndex];
+  std::fill(mDirtyBlocks[slot].begin(), mDirtyBlocks[slot].end(), 0);
+}
+
+void Strip::acquire() {
+  //card thread, after TripleBuffer::acquire()
+  const std::vector<uint64_t>& dirty = mDirtyBlocks[mTripleBuffer->getReadIndex()];
+  for(size_t i = 0; i < dirty.size(); i++) {
+    if(dirty[i]) {
+      mDirty[i] |= dirty[i];
+      mTouched = true;
+    }
+  }
 }
 
 void Strip::serialize() {
-  for(int i = 0; i < mPixels.size(); i++) {
-    mPixelData[3*i+0] = (unsigned char)(mPixels[i]->mRed * mPowerScale);
-    mPixelData[3*i+1] = (unsigned char)(mPixels[i]->mGreen * mPowerScale);
-    mPixelData[3*i+2] = (unsigned char)(mPixels[i]->mBlue * mPowerScale);
+  //re-encode only the runs of dirty blocks; the rest of mPixelData is still current
+  const unsigned char* pixels = mPixels[mTripleBuffer->getReadIndex()].data();
+  int blocks = (mLength + sDirtyBlockPixels - 1) / sDirtyBlockPixels;
+  int runStart = -1;
+  mEncodedBytes = 0;
+  for(int block = 0; block <= blocks; block++) {
+    bool dirty = block < blocks && (mDirty[block >> 6] >> (block & 63)) & 1;
+    if(dirty && runStart < 0) {
+      runStart = block;
+    }
+    else if(!dirty && runStart >= 0) {
+      encode(pixels, runStart * sDirtyBlockPixels, std::min(block * sDirtyBlockPixels, mLength));
+      runStart = -1;
+    }
   }
+  std::fill(mDirty.begin(), mDirty.end(), 0);
+  mTotalEncodedBytes += mEncodedBytes;
   mTouched = false;
 }
 
+void Strip::encode(const unsigned char* pixels, int begin, int end) {
+  //one call per dirty run into the kernel picked at construction
+  int wireBytes = mFormat->wireBytes;
+  mFormat->encode(pixels + begin * mChannels, &mPixelData[begin * wireBytes], end - begin, mPowerScaleFixed.load(std::memory_order_relaxed));
+  mEncodedBytes += wireBytes * (end - begin);
+}
+
+int Strip::getEncodedBytes() {
+  return mEncodedBytes;
+}
+
+unsigned long long Strip::getTotalEncodedBytes() {
+  return mTotalEncodedBytes;
+}
+
+unsigned char* Strip::getStripNumberData() {
+  return mStripNumberData;
+}
+
 unsigned char* Strip::getPixelData() {
   return mPixelData.data();
 }
 
 int Strip::getPixelDataLength() {
-  return mPixels.size();
+  return mPixelData.size();
 }
 
 std::vector<unsigned char>::iterator Strip::begin() {
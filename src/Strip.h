@@ -1,38 +1,112 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <stdint.h>
 #include <vector>
 #include <string>
 #include "Pixel.h"
+#include "Serializer.h"
+#include "PixelFormat.h"
+#include "TripleBuffer.h"
+
+// Strip flag bits a controller advertises for each strip in its beacon.
+enum StripFlag {
+  SFLAG_RGBOW = 1,
+  SFLAG_WIDEPIXELS = 2,
+  SFLAG_LOGARITHMIC = 4,
+  SFLAG_MOTION = 8,
+  SFLAG_NOTIDEMPOTENT = 16,
+  SFLAG_BRIGHTNESS = 32,
+  SFLAG_MONOCHROME = 64
+};
+
+// Non-owning view of a strip's packed channel buffer.  Pixel n starts at
+// data[n * channels]; channels depends on the strip's PixelFormat (3 for RGB,
+// 5 for RGBOW) and the first three bytes are always R,G,B.
+struct PixelView {
+  unsigned char* data;
+  int length;
+  int channels;
+  unsigned char* operator[](int position) const { return data + position * channels; }
+  int size() const { return length * channels; }
+};
 
 class Strip {
  public:
-  Strip(short stripNumber, int length);
+  // length is the controller's pixel count; the strip's own length follows from the format
+  Strip(short stripNumber, int length, PixelFormat format = PIXEL_RGB);
   ~Strip();
   bool isRGBOW();
+  // kept for compatibility; the format is fixed at construction, so this only warns on a mismatch
   void setRGBOW(bool rgbow);
+  PixelFormat getPixelFormat();
   int getLength();
   bool isTouched();
+  void markTouched();
+  void markTouched(int position, int count);
   short getStripNumber();
+  void setAntiLog(bool useAntiLog);
+  bool getAntiLog();
   void setPixels(unsigned char r, unsigned char g, unsigned char b);
-  //void setPixels(unsigned char r, unsigned char g, unsigned char b, unsigned char o, unsigned char w);
+  void setPixels(unsigned char r, unsigned char g, unsigned char b, unsigned char o, unsigned char w);
   void setPixels(std::vector<std::shared_ptr<Pixel> > p);
   void setPixel(int position, unsigned char r, unsigned char g, unsigned char b);
-  //void setPixel(int position, unsigned char r, unsigned char g, unsigned char b, unsigned char o, unsigned char w);
+  void setPixel(int position, unsigned char r, unsigned char g, unsigned char b, unsigned char o, unsigned char w);
   void setPixel(int position, std::shared_ptr<Pixel> pixel);
+  // count packed RGB pixels from position on, as output values; RGBOW strips
+  // get orange and white derived by Serializer::convertRGBOW()
+  void setRGBPixels(int position, const unsigned char* rgb, int count);
+  // one RGB output value into pixel, a pixel of getPixelView(), the way
+  // setRGBPixels() stores it
+  void storeRGBPixel(unsigned char* pixel, const unsigned char* rgb);
   std::vector<std::shared_ptr<Pixel> > getPixels();
+  PixelView getPixelView();
   int getNumPixels();
+  int getChannels();
   void setPowerScale(double powerscale);
+  void setTripleBuffer(std::shared_ptr<TripleBuffer> tripleBuffer);
+  std::shared_ptr<TripleBuffer> getTripleBuffer();
+  void carryOver(int pendingIndex);
+  void commit(int publishedIndex);
+  void acquire();
   void serialize();
+  int getEncodedBytes();
+  unsigned long long getTotalEncodedBytes();
+  unsigned char* getStripNumberData();
   unsigned char* getPixelData(); //remove
   int getPixelDataLength(); //remove
   std::vector<unsigned char>::iterator begin();
   std::vector<unsigned char>::iterator end();
  protected:
-  std::vector<std::shared_ptr<Pixel> > mPixels;
+  static const int sDirtyBlockPixels = 16;
+  void markDirty(int slot, int begin, int end);
+  void encode(const unsigned char* pixels, int begin, int end);
+  void storeRGB(unsigned char* pixel, unsigned char r, unsigned char g, unsigned char b);
+  void storeOW(unsigned char* pixel, unsigned char o, unsigned char w);
+  // three contiguous buffers of mLength * mChannels bytes, pixel-major;
+  // mTripleBuffer says which one the app writes and which one gets sent
+  std::vector<unsigned char> mPixels[3];
+  // one bit per block of sDirtyBlockPixels pixels that changed in that slot
+  std::vector<uint64_t> mDirtyBlocks[3];
+  std::shared_ptr<TripleBuffer> mTripleBuffer;
   std::vector<unsigned char> mPixelData;
+  // pixels the controller drives; wider formats have fewer of their own
+  int mWirePixels;
+  int mLength;
+  int mChannels;
   short mStripNumber;
+  // strip number as it goes on the wire, kept here so packets can point at it
+  unsigned char mStripNumberData[2];
+  // card thread side: blocks changed since the last serialize()
+  std::vector<uint64_t> mDirty;
   bool mTouched;
-  bool mIsRGBOW;
+  int mEncodedBytes;
+  unsigned long long mTotalEncodedBytes;
+  // chosen once at construction; serialize() just calls its encode kernel
+  const PixelFormatSpec* mFormat;
+  bool mUseAntiLog;
   double mPowerScale;
+  // set by the app, read by the sender when it encodes
+  std::atomic<unsigned int> mPowerScaleFixed;
 };
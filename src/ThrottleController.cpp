@@ -0,0 +1,135 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "ThrottleController.h"
+#include <algorithm>
+#include <chrono>
+
+const long ThrottleController::sMaxDelayMicros;
+
+std::shared_ptr<ThrottleController> ThrottleController::create(ThrottleType type) {
+  if(type == THROTTLE_PID) {
+    return std::make_shared<PidThrottle>();
+  }
+  return std::make_shared<AimdThrottle>();
+}
+
+ThrottleController::ThrottleController() {
+  mExtraDelayMicros = 0;
+  mHistory.resize(sHistoryLength);
+  mHistoryNext = 0;
+  mHistoryFull = false;
+}
+
+ThrottleController::~ThrottleController() {
+}
+
+long ThrottleController::update(long deltaSequence, long packetsSent) {
+  double lossRatio = 0.0;
+  if(deltaSequence > 0) {
+    //a controller that reports loss before we counted any sends is saturated
+    lossRatio = packetsSent > 0 ? std::min(1.0, (double)deltaSequence / packetsSent) : 1.0;
+  }
+  std::lock_guard<std::mutex> lock(mMutex);
+  long extraDelayMicros = std::max(0L, std::min(sMaxDelayMicros, compute(lossRatio, mExtraDelayMicros.load())));
+  mExtraDelayMicros = extraDelayMicros;
+
+  ThrottleSample& sample = mHistory[mHistoryNext];
+  sample.timeMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  sample.deltaSequence = deltaSequence;
+  sample.packetsSent = packetsSent;
+  sample.lossRatio = lossRatio;
+  sample.extraDelayMicros = extraDelayMicros;
+  mHistoryNext = (mHistoryNext + 1) % sHistoryLength;
+  if(mHistoryNext == 0) {
+    mHistoryFull = true;
+  }
+  return extraDelayMicros;
+}
+
+long ThrottleController::getExtraDelayMicros() {
+  return mExtraDelayMicros;
+}
+
+void ThrottleController::setExtraDelayMicros(long delay) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mExtraDelayMicros = std::max(0L, std::min(sMaxDelayMicros, delay));
+}
+
+long ThrottleController::adjustExtraDelayMicros(long delta) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  long extraDelayMicros = std::max(0L, std::min(sMaxDelayMicros, mExtraDelayMicros.load() + delta));
+  mExtraDelayMicros = extraDelayMicros;
+  return extraDelayMicros;
+}
+
+std::vector<ThrottleSample> ThrottleController::getHistory() {
+  //oldest first
+  std::lock_guard<std::mutex> lock(mMutex);
+  std::vector<ThrottleSample> history;
+  if(mHistoryFull) {
+    history.insert(history.end(), mHistory.begin() + mHistoryNext, mHistory.end());
+  }
+  history.insert(history.end(), mHistory.begin(), mHistory.begin() + mHistoryNext);
+  return history;
+}
+
+AimdThrottle::AimdThrottle() {
+  mLossThreshold = 0.01;
+  mDecreaseMicros = 250;
+  mBackoff = 2.0;
+}
+
+void AimdThrottle::setParameters(double lossThreshold, long decreaseMicros, double backoff) {
+  mLossThreshold = lossThreshold;
+  mDecreaseMicros = decreaseMicros;
+  mBackoff = backoff;
+}
+
+long AimdThrottle::compute(double lossRatio, long extraDelayMicros) {
+  if(lossRatio > mLossThreshold) {
+    //start backing off from one millisecond so the first step is noticeable
+    return std::max(1000L, (long)(extraDelayMicros * mBackoff));
+  }
+  return extraDelayMicros - mDecreaseMicros;
+}
+
+//about 5us less delay per clean beacon at the default gains
+const double PidThrottle::sCleanError = 0.001;
+
+PidThrottle::PidThrottle() {
+  mTargetLoss = 0.0;
+  mKp = 20000.0;
+  mKi = 5000.0;
+  mKd = 0.0;
+  mIntegral = 0.0;
+  mLastError = 0.0;
+}
+
+void PidThrottle::setParameters(double targetLoss, double kp, double ki, double kd) {
+  mTargetLoss = targetLoss;
+  mKp = kp;
+  mKi = ki;
+  mKd = kd;
+}
+
+long PidThrottle::compute(double lossRatio, long) {
+  //the output is the delay itself, not a step from the current one
+  double error = lossRatio - mTargetLoss;
+  if(lossRatio <= 0.0) {
+    //with no loss there is nothing to measure, so keep probing for a higher rate
+    error = std::min(error, -sCleanError);
+  }
+  double integral = mIntegral + error;
+  double output = mKp * error + mKi * integral + mKd * (error - mLastError);
+  //only wind the integral up while the output is not pinned at a limit
+  if(output > 0.0 && output < sMaxDelayMicros) {
+    mIntegral = integral;
+  }
+  else if((output <= 0.0 && error > 0.0) || (output >= sMaxDelayMicros && error < 0.0)) {
+    mIntegral = integral;
+  }
+  mLastError = error;
+  return (long)output;
+}
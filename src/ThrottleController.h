@@ -0,0 +1,88 @@
+/*
+ * ThrottleController
+ *
+ * Closed-loop extra delay for one PixelPusher.  Every discovery beacon reports
+ * how many packets the controller missed since the last one (deltaSequence);
+ * together with the packets we sent in that time this gives a loss ratio, and
+ * the controller turns that into an extra per-packet delay in microseconds.
+ * Each decision is kept in a fixed-size history for inspection.
+ *
+ * update() runs on the discovery thread while the app may change the delay;
+ * one mutex serializes every change, and the delay itself is atomic so the
+ * sender can read it without taking the lock.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <mutex>
+
+enum ThrottleType {
+  THROTTLE_AIMD,
+  THROTTLE_PID
+};
+
+struct ThrottleSample {
+  long long timeMicros;
+  long deltaSequence;
+  long packetsSent;
+  double lossRatio;
+  long extraDelayMicros;
+};
+
+class ThrottleController {
+ public:
+  static std::shared_ptr<ThrottleController> create(ThrottleType type);
+  ThrottleController();
+  virtual ~ThrottleController();
+  long update(long deltaSequence, long packetsSent);
+  long getExtraDelayMicros();
+  void setExtraDelayMicros(long delay);
+  // adds delta to the delay in one step; returns the new delay
+  long adjustExtraDelayMicros(long delta);
+  std::vector<ThrottleSample> getHistory();
+ protected:
+  virtual long compute(double lossRatio, long extraDelayMicros) = 0;
+  static const long sMaxDelayMicros = 100000;
+ private:
+  static const int sHistoryLength = 256;
+  std::atomic<long> mExtraDelayMicros;
+  std::vector<ThrottleSample> mHistory;
+  int mHistoryNext;
+  bool mHistoryFull;
+  // guards every change to the delay, compute() and the history
+  std::mutex mMutex;
+};
+
+// additive increase of rate while clean, multiplicative backoff on loss
+class AimdThrottle : public ThrottleController {
+ public:
+  AimdThrottle();
+  void setParameters(double lossThreshold, long decreaseMicros, double backoff);
+ protected:
+  long compute(double lossRatio, long extraDelayMicros);
+ private:
+  double mLossThreshold;
+  long mDecreaseMicros;
+  double mBackoff;
+};
+
+// drives the loss ratio towards a target, zero unless set; a clean beacon
+// counts as a small negative error so the delay creeps back down to the edge
+class PidThrottle : public ThrottleController {
+ public:
+  PidThrottle();
+  void setParameters(double targetLoss, double kp, double ki, double kd);
+ protected:
+  long compute(double lossRatio, long extraDelayMicros);
+ private:
+  static const double sCleanError;
+  double mTargetLoss;
+  double mKp;
+  double mKi;
+  double mKd;
+  double mIntegral;
+  double mLastError;
+};
@@ -0,0 +1,94 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "TraceBuffer.h"
+#include <chrono>
+#include <iomanip>
+
+static const char* sEventNames[TRACE_EVENT_TYPES] = {
+  "frame-begin",
+  "packets-sent",
+  "send-failed",
+  "beacon",
+  "pusher-added",
+  "pusher-updated",
+  "pusher-expired",
+  "throttle",
+  "frame-missed"
+};
+
+TraceBuffer* TraceBuffer::getInstance() {
+  //constructed on first use; safe to reach from any thread
+  static TraceBuffer traceBuffer;
+  return &traceBuffer;
+}
+
+const char* TraceBuffer::getEventName(int type) {
+  if(type < 0 || type >= TRACE_EVENT_TYPES) {
+    return "unknown";
+  }
+  return sEventNames[type];
+}
+
+TraceBuffer::TraceBuffer() {
+  clear();
+}
+
+void TraceBuffer::clear() {
+  mHead = 0;
+  for(size_t i = 0; i < sCapacity; i++) {
+    mSlots[i].sequence = 0;
+  }
+}
+
+void TraceBuffer::record(int type, uint64_t pusher, long long arg0, long long arg1) {
+  long long now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  uint64_t ticket = mHead.fetch_add(1, std::memory_order_relaxed);
+  Slot& slot = mSlots[ticket & (sCapacity - 1)];
+  slot.sequence.store(2 * ticket + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.timeMicros.store(now, std::memory_order_relaxed);
+  slot.type.store(type, std::memory_order_relaxed);
+  slot.pusher.store(pusher, std::memory_order_relaxed);
+  slot.arg0.store(arg0, std::memory_order_relaxed);
+  slot.arg1.store(arg1, std::memory_order_relaxed);
+  slot.sequence.store(2 * ticket + 2, std::memory_order_release);
+}
+
+void TraceBuffer::getEvents(std::vector<TraceEvent>& events) {
+  //oldest first; events still being written or already overwritten are left out
+  events.clear();
+  uint64_t head = mHead.load(std::memory_order_acquire);
+  uint64_t first = head > sCapacity ? head - sCapacity : 0;
+  events.reserve(head - first);
+  for(uint64_t ticket = first; ticket < head; ticket++) {
+    Slot& slot = mSlots[ticket & (sCapacity - 1)];
+    uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if(sequence != 2 * ticket + 2) {
+      continue;
+    }
+    TraceEvent event;
+    event.timeMicros = slot.timeMicros.load(std::memory_order_relaxed);
+    event.type = slot.type.load(std::memory_order_relaxed);
+    event.pusher = slot.pusher.load(std::memory_order_relaxed);
+    event.args[0] = slot.arg0.load(std::memory_order_relaxed);
+    event.args[1] = slot.arg1.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(slot.sequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+    events.push_back(event);
+  }
+}
+
+void TraceBuffer::dump(std::ostream& out) {
+  std::vector<TraceEvent> events;
+  getEvents(events);
+  for(size_t i = 0; i < events.size(); i++) {
+    const TraceEvent& event = events[i];
+    out << event.timeMicros << " " << std::setw(14) << std::left << getEventName(event.type) << std::right
+        << " " << std::hex << std::setw(12) << std::setfill('0') << event.pusher << std::dec << std::setfill(' ')
+        << " " << event.args[0] << " " << event.args[1] << "\n";
+  }
+}
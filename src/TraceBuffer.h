@@ -0,0 +1,62 @@
+/*
+ * TraceBuffer
+ *
+ * A fixed-size ring of binary trace events shared by every thread.  Recording
+ * is a fetch_add and a handful of relaxed stores, with no formatting and no
+ * lock; each slot carries a sequence number so a reader can tell a finished
+ * event from one being overwritten.  The newest sCapacity events are kept and
+ * can be copied out or dumped as text on demand.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <ostream>
+#include <stdint.h>
+
+enum TraceEventType {
+  TRACE_FRAME_BEGIN,      // strips to send, packet interval in usec
+  TRACE_PACKETS_SENT,     // packets, bytes
+  TRACE_SEND_FAILED,      // packets, errno
+  TRACE_BEACON,           // delta sequence, update period
+  TRACE_PUSHER_ADDED,     // group id, controller id
+  TRACE_PUSHER_UPDATED,   // group id, controller id
+  TRACE_PUSHER_EXPIRED,   // silence in usec, timeout in msec
+  TRACE_THROTTLE,         // packets reported lost, extra delay in usec
+  TRACE_FRAME_MISSED,     // group frame number, usec past its window (0 if it never went out)
+  TRACE_EVENT_TYPES
+};
+
+struct TraceEvent {
+  // steady_clock microseconds
+  long long timeMicros;
+  int type;
+  // packed MAC of the pusher (BeaconView::getMacKey), 0 when not about one
+  uint64_t pusher;
+  long long args[2];
+};
+
+class TraceBuffer {
+ public:
+  static const size_t sCapacity = 4096;
+  static TraceBuffer* getInstance();
+  static const char* getEventName(int type);
+  void record(int type, uint64_t pusher, long long arg0, long long arg1);
+  void getEvents(std::vector<TraceEvent>& events);
+  void dump(std::ostream& out);
+  void clear();
+ private:
+  struct Slot {
+    // 2 * ticket + 1 while being written, 2 * ticket + 2 once complete
+    std::atomic<uint64_t> sequence;
+    std::atomic<long long> timeMicros;
+    std::atomic<int> type;
+    std::atomic<uint64_t> pusher;
+    std::atomic<long long> arg0;
+    std::atomic<long long> arg1;
+  };
+  TraceBuffer();
+  std::atomic<uint64_t> mHead;
+  Slot mSlots[sCapacity];
+};
@@ -0,0 +1,41 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "Transport.h"
+#include "PosixTransport.h"
+#include "OfxUdpTransport.h"
+#include "PixelPusherLog.h"
+
+TransportOptions::TransportOptions() {
+  sendBufferBytes = 0;
+  receiveBufferBytes = 0;
+  dscp = -1;
+  nonBlocking = true;
+}
+
+std::shared_ptr<Transport> Transport::create(TransportType type) {
+#ifdef TARGET_WIN32
+  if(type == TRANSPORT_POSIX) {
+    PP_LOG_WARNING("PosixTransport is not available on Windows; using ofxUDPManager");
+  }
+  type = TRANSPORT_OFXUDP;
+#endif
+#ifdef PIXELPUSHER_HEADLESS
+  if(type == TRANSPORT_OFXUDP) {
+    PP_LOG_WARNING("ofxUDPManager is not available in headless builds; using POSIX sockets");
+  }
+  type = TRANSPORT_POSIX;
+#endif
+
+#ifndef TARGET_WIN32
+  if(type == TRANSPORT_DEFAULT || type == TRANSPORT_POSIX) {
+    return std::shared_ptr<Transport>(new PosixTransport());
+  }
+#endif
+#ifndef PIXELPUSHER_HEADLESS
+  return std::shared_ptr<Transport>(new OfxUdpTransport());
+#else
+  return std::shared_ptr<Transport>();
+#endif
+}
@@ -0,0 +1,64 @@
+/*
+ * Transport
+ *
+ * The UDP socket a PixelPusher sends through, or the DiscoveryListener
+ * receives beacons on, behind one small interface.  PosixTransport is a
+ * native non-blocking socket with tunable buffers, DSCP marking and one
+ * connected socket per controller; OfxUdpTransport wraps ofxUDPManager and
+ * is what Windows builds use.  Defining PIXELPUSHER_HEADLESS leaves the
+ * ofxUDPManager backend out so nothing from openFrameworks is needed.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <cstddef>
+
+#ifdef TARGET_WIN32
+struct iovec {
+  void* iov_base;
+  size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
+
+enum TransportType {
+  // PosixTransport where available, OfxUdpTransport otherwise
+  TRANSPORT_DEFAULT,
+  TRANSPORT_POSIX,
+  TRANSPORT_OFXUDP
+};
+
+struct TransportOptions {
+  TransportOptions();
+  // kernel buffer sizes in bytes; 0 keeps the system default
+  int sendBufferBytes;
+  int receiveBufferBytes;
+  // DiffServ code point for outgoing packets (46 is expedited forwarding); -1 leaves them unmarked
+  int dscp;
+  // a full send buffer drops the rest of the batch instead of stalling the sender
+  bool nonBlocking;
+};
+
+class Transport {
+ public:
+  static std::shared_ptr<Transport> create(TransportType type);
+  virtual ~Transport() {}
+  // for sending to one controller; calling it again closes the socket and reconnects
+  virtual bool connect(const std::string& address, int port, const TransportOptions& options) = 0;
+  // for receiving on a local port
+  virtual bool bind(int port, const TransportOptions& options) = 0;
+  virtual void close() = 0;
+  // sends packets datagrams, packet p being iov[starts[p]] up to iov[starts[p + 1]];
+  // returns how many went out, which is fewer when the socket would block or fails
+  virtual int send(const iovec* iov, const size_t* starts, size_t packets) = 0;
+  // one datagram, or <= 0 when nothing is waiting
+  virtual int receive(unsigned char* buffer, int length) = 0;
+  // descriptor to poll() for incoming data, or -1 if receive() waits by itself
+  virtual int getDescriptor() = 0;
+  // errno of the last failed call, 0 if none
+  virtual int getLastError() = 0;
+  virtual const char* getName() = 0;
+};
@@ -0,0 +1,53 @@
+#ifdef TARGET_WIN32
+#include "stdafx.h"
+#endif
+
+#include "TripleBuffer.h"
+
+TripleBuffer::TripleBuffer() {
+  mWrite = 0;
+  mMiddle = 1;
+  mRead = 2;
+  mDroppedFrames = 0;
+}
+
+int TripleBuffer::getWriteIndex() {
+  return mWrite;
+}
+
+int TripleBuffer::getReadIndex() {
+  return mRead;
+}
+
+int TripleBuffer::getPendingIndex() {
+  //writer side: the slot of a published frame the reader has not picked up yet, or -1
+  int middle = mMiddle.load(std::memory_order_acquire);
+  if(middle & sFresh) {
+    return middle & 3;
+  }
+  return -1;
+}
+
+int TripleBuffer::publish() {
+  //returns the slot that was just published
+  int published = mWrite;
+  int previous = mMiddle.exchange(published | sFresh, std::memory_order_acq_rel);
+  if(previous & sFresh) {
+    mDroppedFrames++;
+  }
+  mWrite = previous & 3;
+  return published;
+}
+
+bool TripleBuffer::acquire() {
+  if(!(mMiddle.load(std::memory_order_relaxed) & sFresh)) {
+    return false;
+  }
+  int previous = mMiddle.exchange(mRead, std::memory_order_acq_rel);
+  mRead = previous & 3;
+  return true;
+}
+
+unsigned long TripleBuffer::getDroppedFrames() {
+  return mDroppedFrames;
+}
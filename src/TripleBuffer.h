@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+ * TripleBuffer
+ *
+ * Index bookkeeping for a lock-free triple buffer.  It owns no pixel memory;
+ * it only decides which of three slots the writer (app thread) and reader
+ * (card thread) may use.  A PixelPusher shares one TripleBuffer among all of
+ * its strips, so a publish() hands over every strip of the frame at once.
+ *
+ * The writer calls publish() after filling its slot; the reader calls
+ * acquire() before sending.  Neither call ever blocks.
+ */
+
+#include <atomic>
+
+class TripleBuffer {
+ public:
+  TripleBuffer();
+  int getWriteIndex();
+  int getReadIndex();
+  int getPendingIndex();
+  int publish();
+  bool acquire();
+  unsigned long getDroppedFrames();
+ private:
+  static const int sFresh = 4;
+  // index of the middle slot, plus sFresh while the reader has not taken it
+  std::atomic<int> mMiddle;
+  int mWrite;
+  int mRead;
+  unsigned long mDroppedFrames;
+};